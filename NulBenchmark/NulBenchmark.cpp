@@ -0,0 +1,401 @@
+#include "SrStatus.h"
+#include "PacketPool.h"
+#include "ContentCache.h"
+#include "UdpPacket.h"
+#include "Socket.h"
+#include "WSAConnection.h"
+#include "util.h"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <format>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+
+// Microbenchmarks of the per-packet paths of the protocols and of util. Every benchmark runs until it
+// has taken at least MIN_DURATION, and the results are written as CSV to stdout, one row per benchmark:
+//   name,iterations,ns_per_op,allocs_per_op,bytes_per_op
+// Allocations are counted by replacing the global operator new of this program. Arguments select the
+// benchmarks whose names start with one of them.
+
+namespace {
+	constexpr std::chrono::milliseconds MIN_DURATION(200);
+	constexpr const char* CONTENT_PATH = "NulBenchmark.content.tmp";
+	constexpr size_t CONTENT_LENGTH = 64 * 1024;
+
+	std::atomic<uint64_t> allocations = 0;
+	std::atomic<uint64_t> allocatedBytes = 0;
+
+	// Keeps the optimizer from discarding a result: its address escapes, and the fence makes the compiler
+	// assume it is read right here.
+	template<typename T>
+	void Keep(const T& value) {
+		static const void* volatile sink;
+		sink = &value;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+
+	struct Benchmark {
+		const char* name;
+		// Runs the operation `iterations` times.
+		std::function<void(size_t iterations)> run;
+	};
+
+	struct Result {
+		size_t iterations;
+		double nanoseconds;
+		double allocations;
+		double bytes;
+	};
+
+	Result Measure(const Benchmark& benchmark) {
+		typedef std::chrono::steady_clock Clock;
+		benchmark.run(1);
+
+		// Grow the batch until one run is long enough to time.
+		for (size_t iterations = 1; ; iterations *= 2) {
+			uint64_t allocationsBefore = allocations.load(), bytesBefore = allocatedBytes.load();
+			Clock::time_point start = Clock::now();
+			benchmark.run(iterations);
+			Clock::duration elapsed = Clock::now() - start;
+			if (elapsed >= MIN_DURATION) {
+				return { iterations,
+					(double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (double)iterations,
+					(double)(allocations.load() - allocationsBefore) / (double)iterations,
+					(double)(allocatedBytes.load() - bytesBefore) / (double)iterations };
+			}
+		}
+	}
+
+	// Written on first use and removed when the program ends.
+	const char* ContentFile() {
+		static const bool written = []() {
+			std::ofstream ofs(CONTENT_PATH, std::ios::binary);
+			ofs << std::string(CONTENT_LENGTH, 'x');
+			return true;
+		}();
+		Keep(written);
+		return CONTENT_PATH;
+	}
+
+	// One full window of the SR sender: send every segment, acknowledge them all, then slide.
+	void SrSendWindow(SrStatus& status) {
+		++status.tick;
+		status.forEachExpired([](uint8_t, uint32_t) {});
+		status.forEachUnsent([&](uint8_t seq, uint32_t) {
+			status.markSent(seq, status.tick + 20);
+		});
+		status.forEachElementInWindow([&](uint8_t seq, uint32_t) {
+			status.acknowledge(seq);
+		});
+		status.moveWindow();
+	}
+
+	std::vector<Benchmark> CreateBenchmarks() {
+		std::vector<Benchmark> benchmarks;
+
+		benchmarks.push_back({ "sr.forEachElementInWindow", [](size_t iterations) {
+			SrStatus status(SR_SEND_WINDOW_SIZE, UINT32_MAX);
+			uint32_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				status.forEachElementInWindow([&](uint8_t seq, uint32_t totalSeq) {
+					total += seq + totalSeq;
+				});
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "sr.moveWindow", [](size_t iterations) {
+			SrStatus status(SR_SEND_WINDOW_SIZE, UINT32_MAX);
+			for (size_t i = 0; i < iterations; ++i) {
+				status.acknowledge(status.curSeq);
+				status.moveWindow();
+				Keep(status);
+			}
+			Keep(status.totalSeq);
+		} });
+
+		benchmarks.push_back({ "sr.sendWindow", [](size_t iterations) {
+			SrStatus status(SR_SEND_WINDOW_SIZE, UINT32_MAX);
+			for (size_t i = 0; i < iterations; ++i) {
+				SrSendWindow(status);
+			}
+			Keep(status.totalSeq);
+		} });
+
+		benchmarks.push_back({ "sr.accept.inOrder", [](size_t iterations) {
+			SrReceiveStatus status;
+			std::string result;
+			uint8_t payload[UdpPacket::MAX_DATA_LENGTH] = {};
+			for (size_t i = 0; i < iterations; ++i) {
+				status.accept(result, status.seq, payload, (int)sizeof(payload), false);
+				if (result.size() >= (1 << 20)) {
+					result.clear();
+				}
+			}
+			Keep(status.totalSeq);
+		} });
+
+		benchmarks.push_back({ "sr.accept.reordered", [](size_t iterations) {
+			// Every window arrives in reverse, so each segment is buffered before the last one flushes it.
+			SrReceiveStatus status;
+			std::string result;
+			uint8_t payload[UdpPacket::MAX_DATA_LENGTH] = {};
+			for (size_t i = 0; i < iterations; i += SR_RECEIVE_WINDOW_SIZE) {
+				uint8_t start = status.seq;
+				for (int j = SR_RECEIVE_WINDOW_SIZE - 1; j >= 0; --j) {
+					status.accept(result, (uint8_t)((start + j) % SR_SEQ_SIZE), payload, (int)sizeof(payload), false);
+				}
+				if (result.size() >= (1 << 20)) {
+					result.clear();
+				}
+			}
+			Keep(status.totalSeq);
+		} });
+
+		benchmarks.push_back({ "packet.writeData", [](size_t iterations) {
+			// Packetization as done by GBN and SR for every data segment.
+			std::string data(UdpPacket::MAX_DATA_LENGTH * 64, 'x');
+			uint8_t buffer[UdpPacket::MAX_LENGTH];
+			int length = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				size_t offset = (i % 64) * UdpPacket::MAX_DATA_LENGTH;
+				length += UdpPacket::write(buffer, UdpPacket::Type::DATA, (uint32_t)i % SR_SEQ_SIZE,
+					data.data() + offset, UdpPacket::MAX_DATA_LENGTH);
+			}
+			Keep(length);
+		} });
+
+		benchmarks.push_back({ "packet.readData", [](size_t iterations) {
+			uint8_t buffer[UdpPacket::MAX_LENGTH];
+			uint8_t payload[UdpPacket::MAX_DATA_LENGTH] = {};
+			int length = UdpPacket::write(buffer, UdpPacket::Type::DATA, 3, payload, sizeof(payload));
+			UdpPacket::Header header;
+			uint32_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				total += UdpPacket::read(buffer, length, header) ? header.length : 0;
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "packet.writeAck", [](size_t iterations) {
+			uint8_t buffer[UdpPacket::HEADER_LENGTH];
+			int length = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				length += UdpPacket::write(buffer, UdpPacket::Type::ACK, (uint32_t)i % SR_SEQ_SIZE);
+			}
+			Keep(length);
+		} });
+
+		benchmarks.push_back({ "pool.makeUnique", [](size_t iterations) {
+			// What every protocol call used to pay for its packet buffer.
+			for (size_t i = 0; i < iterations; ++i) {
+				std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(UdpPacket::MAX_LENGTH);
+				Keep(buffer);
+			}
+		} });
+
+		benchmarks.push_back({ "pool.acquire", [](size_t iterations) {
+			PacketPool& pool = PacketPool::local();
+			for (size_t i = 0; i < iterations; ++i) {
+				PacketBuffer buffer = pool.acquire();
+				Keep(buffer);
+			}
+		} });
+
+		benchmarks.push_back({ "pool.share", [](size_t iterations) {
+			// A segment kept for retransmission while a copy of the handle is in use.
+			PacketBuffer buffer = PacketPool::local().acquire();
+			for (size_t i = 0; i < iterations; ++i) {
+				PacketBuffer copy = buffer;
+				Keep(copy);
+			}
+		} });
+
+		benchmarks.push_back({ "content.readFile", [](size_t iterations) {
+			// What every transfer used to pay for its data: the file read one character at a time.
+			for (size_t i = 0; i < iterations; ++i) {
+				std::ifstream ifs(ContentFile(), std::ios::binary);
+				std::string result;
+				int c;
+				while ((c = ifs.get()) != EOF) {
+					result += (char)c;
+				}
+				Keep(result);
+			}
+		} });
+
+		benchmarks.push_back({ "content.get", [](size_t iterations) {
+			ContentCache cache(CONTENT_LENGTH);
+			for (size_t i = 0; i < iterations; ++i) {
+				std::shared_ptr<const Content> content = cache.get(ContentFile());
+				Keep(content);
+			}
+		} });
+
+		benchmarks.push_back({ "address.construct", [](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				Socket::Address address("127.0.0.1", (unsigned short)(10000 + i % 1000));
+				Keep(address);
+			}
+		} });
+
+		benchmarks.push_back({ "address.constructHost", [](size_t iterations) {
+			// Host names are answered from the resolver cache after the first call.
+			for (size_t i = 0; i < iterations; ++i) {
+				Socket::Address address("localhost", 10000);
+				Keep(address);
+			}
+		} });
+
+		benchmarks.push_back({ "address.copy", [](size_t iterations) {
+			Socket::Address source("127.0.0.1", 10000);
+			for (size_t i = 0; i < iterations; ++i) {
+				Socket::Address copy = source;
+				Keep(copy);
+			}
+		} });
+
+		benchmarks.push_back({ "address.hash", [](size_t iterations) {
+			Socket::Address address("127.0.0.1", 10000);
+			size_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				total += std::hash<Socket::Address>()(address);
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "util.trim", [](size_t iterations) {
+			std::string line = "   -testsr 8 1024   \r\n";
+			for (size_t i = 0; i < iterations; ++i) {
+				std::string result = util::trim(line);
+				Keep(result);
+			}
+		} });
+
+		benchmarks.push_back({ "util.trim_view", [](size_t iterations) {
+			std::string line = "   -testsr 8 1024   \r\n";
+			for (size_t i = 0; i < iterations; ++i) {
+				std::string_view result = util::trim_view(line);
+				Keep(result);
+			}
+		} });
+
+		benchmarks.push_back({ "util.split", [](size_t iterations) {
+			std::string line = "-teststripe 0.1 0.2 0.3 0.05";
+			for (size_t i = 0; i < iterations; ++i) {
+				std::vector<std::string> result = util::split(line, " ");
+				Keep(result);
+			}
+		} });
+
+		benchmarks.push_back({ "util.split_view", [](size_t iterations) {
+			std::string line = "-teststripe 0.1 0.2 0.3 0.05";
+			size_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				for (std::string_view part : util::split_view(line, " ")) {
+					total += part.size();
+				}
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "util.get_local_time_string", [](size_t iterations) {
+			for (size_t i = 0; i < iterations; ++i) {
+				std::string result = util::get_local_time_string("%Y.%m.%d %H:%M:%S");
+				Keep(result);
+			}
+		} });
+
+		benchmarks.push_back({ "util.time_formatter", [](size_t iterations) {
+			util::time_formatter formatter;
+			char buffer[64];
+			size_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				total += formatter.format(buffer, sizeof(buffer));
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "util.monotonic_ns", [](size_t iterations) {
+			uint64_t total = 0;
+			for (size_t i = 0; i < iterations; ++i) {
+				total += util::monotonic_ns();
+			}
+			Keep(total);
+		} });
+
+		benchmarks.push_back({ "logger.format", [](size_t iterations) {
+			// What the protocols pay per logged packet when nobody listens.
+			std::function<void(std::string)> logger = [](std::string) {};
+			for (size_t i = 0; i < iterations; ++i) {
+				logger(std::format("[Server] Sent data package seq {}", i % SR_SEQ_SIZE));
+			}
+		} });
+
+		benchmarks.push_back({ "logger.locked", [](size_t iterations) {
+			// The shape of UdpReliableServer::setLogger: a mutex around a logger that keeps the message.
+			std::mutex mutex;
+			size_t total = 0;
+			std::function<void(std::string)> inner = [&](std::string message) {
+				total += message.size();
+			};
+			std::function<void(std::string)> logger = [&](std::string message) {
+				std::lock_guard<std::mutex> locked(mutex);
+				inner(message);
+			};
+			for (size_t i = 0; i < iterations; ++i) {
+				logger(std::format("[Server] Sent data package seq {}", i % SR_SEQ_SIZE));
+			}
+			Keep(total);
+		} });
+
+		return benchmarks;
+	}
+}
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+	std::free(pointer);
+}
+
+int main(int argc, char* argv[]) {
+	WSAConnection wsaConnection;
+	std::vector<std::string_view> filters(argv + 1, argv + argc);
+
+	std::cout << "name,iterations,ns_per_op,allocs_per_op,bytes_per_op" << std::endl;
+	for (const Benchmark& benchmark : CreateBenchmarks()) {
+		bool selected = filters.empty();
+		for (std::string_view filter : filters) {
+			selected = selected || std::string_view(benchmark.name).starts_with(filter);
+		}
+		if (!selected) {
+			continue;
+		}
+		Result result = Measure(benchmark);
+		std::cout << std::format("{},{},{:.2f},{:.3f},{:.1f}", benchmark.name, result.iterations, result.nanoseconds,
+			result.allocations, result.bytes) << std::endl;
+	}
+	std::remove(CONTENT_PATH);
+	return 0;
+}
@@ -0,0 +1,286 @@
+#include "UdpReliableServer.h"
+#include "CommandSession.h"
+#include "GbnProtocol.h"
+#include "SrProtocol.h"
+#include "EventLoop.h"
+#include "WSAConnection.h"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <format>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+
+// Open-loop load generator for UdpReliableServer. Requests are issued on a fixed schedule whatever the
+// server does, spread over many command sessions that each own a socket, and mixed between echo, -time
+// and GBN and SR transfers. Latency is measured from the moment a request was due, not from when it was
+// actually sent, so a server that falls behind shows up in the percentiles instead of slowing the load
+// down. Results are written as CSV to stdout, one row per kind of request and one for all of them, where
+// per_second counts the successful requests over the whole run, including the wait for the last replies:
+//   kind,requests,errors,per_second,p50_us,p99_us,p999_us,max_us
+//
+// Usage: NulLoadGen <host> <port> [options]
+//   -rate <n>            requests per second over all threads, 1000 by default
+//   -duration <s>        seconds to issue requests for, 10 by default
+//   -sessions <n>        command sessions, 1000 by default
+//   -threads <n>         event loops driving the sessions, one per processor by default
+//   -mix <e>,<t>,<g>,<s> relative weights of echo, -time, GBN and SR, 70,25,3,2 by default
+//   -loss <rate>         simulated loss rate of transfers, 0 by default
+//   -serve               runs the server in this process, listening on <host> <port>
+//
+// The server keeps its per-peer rate limits by IP address, so every session of one generator counts as a
+// single peer. The server started by -serve lifts those limits and keeps only its server-wide ones. Any
+// other server holds the whole run to its per-peer defaults, 1000 packets and 2 transfers a second, and
+// the requests beyond them are reported as errors.
+
+namespace {
+	enum class Kind {
+		ECHO,
+		TIME,
+		GBN,
+		SR,
+		COUNT
+	};
+
+	constexpr const char* KIND_NAMES[] = { "echo", "time", "gbn", "sr" };
+	constexpr size_t KIND_COUNT = (size_t)Kind::COUNT;
+	// How often the generator of a loop wakes up to issue the requests that have fallen due.
+	constexpr unsigned long ISSUE_INTERVAL = 1;
+	constexpr unsigned long DRAIN_INTERVAL = 100;
+
+	typedef EventLoop::Clock Clock;
+
+	struct Options {
+		std::string host;
+		unsigned short port = 0;
+		double rate = 1000;
+		double duration = 10;
+		size_t sessions = 1000;
+		size_t threads = 0;
+		double mix[KIND_COUNT] = { 70, 25, 3, 2 };
+		double loss = 0;
+		bool serve = false;
+	};
+
+	// Everything one loop measured; merged once all loops are done.
+	struct Report {
+		std::vector<uint32_t> latencies[KIND_COUNT];	// Microseconds, successful requests only.
+		size_t requests[KIND_COUNT] = {};
+		size_t errors[KIND_COUNT] = {};
+	};
+
+	struct Generator {
+		WSAConnection wsaConnection;
+		EventLoop loop;
+		std::vector<std::unique_ptr<CommandSession>> sessions;
+		size_t nextSession = 0;
+		size_t inFlight = 0;
+		Report report;
+
+		explicit Generator(WSAConnection wsaConnection) : wsaConnection(wsaConnection) {}
+	};
+
+	Options ParseOptions(int argc, char* argv[]) {
+		if (argc < 3) {
+			throw std::invalid_argument("Usage: NulLoadGen <host> <port> [-rate n] [-duration s] [-sessions n] "
+				"[-threads n] [-mix echo,time,gbn,sr] [-loss rate] [-serve]");
+		}
+		Options options;
+		options.host = argv[1];
+		options.port = (unsigned short)std::stoi(argv[2]);
+		for (int i = 3; i < argc; ++i) {
+			std::string_view option = argv[i];
+			if (option == "-serve") {
+				options.serve = true;
+				continue;
+			}
+			if (i + 1 >= argc) {
+				throw std::invalid_argument(std::format("Missing value of {}", option));
+			}
+			std::string value = argv[++i];
+			if (option == "-rate") {
+				options.rate = std::stod(value);
+			} else if (option == "-duration") {
+				options.duration = std::stod(value);
+			} else if (option == "-sessions") {
+				options.sessions = std::max<size_t>(1, std::stoul(value));
+			} else if (option == "-threads") {
+				options.threads = std::stoul(value);
+			} else if (option == "-loss") {
+				options.loss = std::stod(value);
+			} else if (option == "-mix") {
+				size_t start = 0;
+				for (size_t kind = 0; kind < KIND_COUNT; ++kind) {
+					size_t end = std::min(value.find(',', start), value.size());
+					options.mix[kind] = start < value.size() ? std::stod(value.substr(start, end - start)) : 0;
+					start = end + 1;
+				}
+			} else {
+				throw std::invalid_argument(std::format("Unknown option {}", option));
+			}
+		}
+		if (options.threads == 0) {
+			options.threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		options.threads = std::min(options.threads, options.sessions);
+		return options;
+	}
+
+	// A failed request is one that got no reply, the wrong reply, or no data.
+	Task<bool> Issue(Generator& generator, const Options& options, Kind kind, uint64_t id) {
+		switch (kind) {
+		case Kind::ECHO: {
+			CommandSession& session = *generator.sessions[generator.nextSession++ % generator.sessions.size()];
+			std::string message = std::format("load {}", id);
+			co_return co_await session.requestAsync(generator.loop, message) == message;
+		}
+		case Kind::TIME: {
+			CommandSession& session = *generator.sessions[generator.nextSession++ % generator.sessions.size()];
+			co_return !(co_await session.requestAsync(generator.loop, "-time")).empty();
+		}
+		case Kind::GBN: {
+			GbnProtocol protocol(generator.wsaConnection);
+			co_return !(co_await protocol.receiveAsync(generator.loop, options.host, options.port, options.loss,
+				options.loss)).empty();
+		}
+		case Kind::SR: {
+			SrProtocol protocol(generator.wsaConnection);
+			co_return !(co_await protocol.receiveAsync(generator.loop, options.host, options.port, options.loss,
+				options.loss)).empty();
+		}
+		}
+		co_return false;
+	}
+
+	Task<void> Measure(Generator& generator, const Options& options, Kind kind, uint64_t id, Clock::time_point due) {
+		bool succeeded = false;
+		try {
+			succeeded = co_await Issue(generator, options, kind, id);
+		} catch (const std::exception&) {
+			succeeded = false;
+		}
+		size_t index = (size_t)kind;
+		++generator.report.requests[index];
+		if (succeeded) {
+			auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due);
+			generator.report.latencies[index].push_back((uint32_t)std::min<long long>(latency.count(), UINT32_MAX));
+		} else {
+			++generator.report.errors[index];
+		}
+		--generator.inFlight;
+	}
+
+	// Issues the share of one loop on its schedule, then waits for the requests still in flight.
+	Task<void> Generate(Generator& generator, const Options& options, size_t index, Clock::time_point start) {
+		double rate = options.rate / (double)options.threads;
+		uint64_t total = (uint64_t)std::llround(rate * options.duration);
+		auto interval = std::chrono::duration<double>(1.0 / rate);
+		std::default_random_engine randomEngine((unsigned)(std::random_device()() + index));
+		std::discrete_distribution<size_t> kindRandom(std::begin(options.mix), std::end(options.mix));
+
+		for (uint64_t issued = 0; issued < total; ) {
+			Clock::time_point now = Clock::now();
+			for (; issued < total; ++issued) {
+				Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(interval * (double)issued);
+				if (due > now) {
+					break;
+				}
+				++generator.inFlight;
+				generator.loop.spawn(Measure(generator, options, (Kind)kindRandom(randomEngine),
+					issued * options.threads + index, due));
+			}
+			co_await generator.loop.sleep(ISSUE_INTERVAL);
+		}
+		while (generator.inFlight > 0) {
+			co_await generator.loop.until([&generator]() { return generator.inFlight == 0; }, DRAIN_INTERVAL);
+		}
+	}
+
+	uint32_t Percentile(const std::vector<uint32_t>& sorted, double fraction) {
+		if (sorted.empty()) {
+			return 0;
+		}
+		size_t rank = (size_t)std::ceil(fraction * (double)sorted.size());
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	void PrintRow(std::string_view kind, std::vector<uint32_t>& latencies, size_t requests, size_t errors,
+		double seconds) {
+		std::sort(latencies.begin(), latencies.end());
+		std::cout << std::format("{},{},{},{:.1f},{},{},{},{}", kind, requests, errors,
+			(double)(requests - errors) / seconds, Percentile(latencies, 0.5), Percentile(latencies, 0.99),
+			Percentile(latencies, 0.999), latencies.empty() ? 0 : latencies.back()) << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		Options options = ParseOptions(argc, argv);
+		WSAConnection wsaConnection;
+		std::unique_ptr<UdpReliableServer> server;
+		if (options.serve) {
+			server = std::make_unique<UdpReliableServer>(wsaConnection);
+			server->setPeerRateLimits({ 0, 0 }, { 0, 0 });
+			server->init(options.host, options.port);
+			server->start();
+		}
+
+		// Sessions are opened on this thread before the clock starts, and each one is only ever used by the
+		// loop of the generator it is handed to.
+		std::vector<std::unique_ptr<Generator>> generators;
+		Socket::Address target(options.host, options.port);
+		for (size_t i = 0; i < options.threads; ++i) {
+			generators.push_back(std::make_unique<Generator>(wsaConnection));
+		}
+		for (size_t i = 0; i < options.sessions; ++i) {
+			generators[i % options.threads]->sessions.push_back(std::make_unique<CommandSession>(wsaConnection, target));
+		}
+
+		Clock::time_point start = Clock::now();
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < options.threads; ++i) {
+			threads.emplace_back([&generators, &options, i, start]() {
+				Generator& generator = *generators[i];
+				generator.loop.run(Generate(generator, options, i, start));
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::cout << "kind,requests,errors,per_second,p50_us,p99_us,p999_us,max_us" << std::endl;
+		std::vector<uint32_t> all;
+		size_t allRequests = 0, allErrors = 0;
+		for (size_t kind = 0; kind < KIND_COUNT; ++kind) {
+			std::vector<uint32_t> latencies;
+			size_t requests = 0, errors = 0;
+			for (const std::unique_ptr<Generator>& generator : generators) {
+				const Report& report = generator->report;
+				latencies.insert(latencies.end(), report.latencies[kind].begin(), report.latencies[kind].end());
+				requests += report.requests[kind];
+				errors += report.errors[kind];
+			}
+			all.insert(all.end(), latencies.begin(), latencies.end());
+			allRequests += requests;
+			allErrors += errors;
+			PrintRow(KIND_NAMES[kind], latencies, requests, errors, seconds);
+		}
+		PrintRow("all", all, allRequests, allErrors, seconds);
+
+		if (server != nullptr) {
+			server->close();
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+// Spin budget for busy polling before falling back to a blocking wait. The budget doubles back towards
+// the configured limit while spinning keeps catching packets and halves whenever a spin comes up empty,
+// so a busy socket wakes up within microseconds while an idle one soon stops burning CPU. A limit of
+// zero, the default, disables spinning.
+class BusyPoll final {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	BusyPoll(unsigned long limit = 0) : limit(limit), budget(limit) {}
+	BusyPoll(const BusyPoll& other) : limit(other.limit.load()), budget(other.budget) {}
+
+	BusyPoll& operator=(const BusyPoll& other) {
+		limit = other.limit.load();
+		budget = other.budget;
+		return *this;
+	}
+
+	// May be called from any thread. The budget belongs to the thread that spins, which brings it within a
+	// lowered limit on its next spin and grows it towards a raised one as spinning pays off.
+	void setLimit(unsigned long microseconds) {
+		limit = microseconds;
+	}
+
+	unsigned long getLimit() const {
+		return limit;
+	}
+
+	// Calls `check` until it returns true, the budget is spent or `deadline` passes.
+	template<typename Check>
+	bool spin(Check check, Clock::time_point deadline) {
+		unsigned long currentLimit = limit;
+		if (currentLimit == 0) {
+			return false;
+		}
+		budget = std::min(budget, currentLimit);
+
+		Clock::time_point end = std::min(deadline, Clock::now() + std::chrono::microseconds(budget));
+		do {
+			if (check()) {
+				budget = std::min(currentLimit, std::max(budget * 2, MIN_BUDGET));
+				return true;
+			}
+		} while (Clock::now() < end);
+
+		budget = std::max(budget / 2, MIN_BUDGET);
+		return false;
+	}
+
+private:
+	static constexpr unsigned long MIN_BUDGET = 1;
+
+	std::atomic<unsigned long> limit;
+	unsigned long budget;
+};
+
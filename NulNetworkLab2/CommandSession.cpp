@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "sock.h"
+#include "CommandSession.h"
+#include "UdpPacket.h"
+#include <random>
+#include <algorithm>
+
+// The first attempt waits this long for a reply, and every retry waits twice as long as the one before.
+constexpr unsigned long REQUEST_TIMEOUT = 250;
+constexpr int MAX_REQUEST_ATTEMPTS = 4;
+
+namespace {
+	unsigned long RemainingMilliseconds(EventLoop::Clock::time_point deadline) {
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - EventLoop::Clock::now());
+		return remaining.count() > 0 ? (unsigned long)remaining.count() : 0;
+	}
+}
+
+CommandSession::CommandSession(WSAConnection wsaConnection, const Socket::Address& target) 
+	: socket(wsaConnection), target(target), buffer(std::make_unique<uint8_t[]>(UdpPacket::MAX_LENGTH)), 
+	nextRequestId(std::random_device()()), receiving(false) {
+	socket.init(Socket::ProtocolType::UDP, target.getIpType());
+	socket.setBlockMode(false);
+}
+
+Task<std::string> CommandSession::requestAsync(EventLoop& loop, std::string command) {
+	uint32_t requestId = nextRequestId++;
+	std::unique_ptr<uint8_t[]> packet = std::make_unique<uint8_t[]>(UdpPacket::MAX_LENGTH);
+	int packetLength = UdpPacket::write(packet.get(), UdpPacket::Type::REQUEST, requestId, command.data(), 
+		command.size());
+
+	PendingRequest request;
+	pending[requestId] = &request;
+	try {
+		unsigned long timeout = REQUEST_TIMEOUT;
+		for (int attempt = 0; attempt < MAX_REQUEST_ATTEMPTS && !request.done; ++attempt, timeout *= 2) {
+			socket.send(packet.get(), packetLength, target);
+			EventLoop::Clock::time_point deadline = EventLoop::Clock::now() + std::chrono::milliseconds(timeout);
+
+			while (!request.done) {
+				unsigned long remaining = RemainingMilliseconds(deadline);
+				if (remaining == 0) {
+					break;
+				}
+				if (receiving) {
+					// Someone else reads the socket; wait until it hands over our reply or stops reading.
+					co_await loop.until([this, &request]() { return request.done || !receiving; }, remaining);
+					continue;
+				}
+
+				receiving = true;
+				Socket::Address sender;
+				EventLoop::ReceiveResult received = co_await loop.receive(socket, buffer.get(), 
+					(int)UdpPacket::MAX_LENGTH, sender, remaining);
+				receiving = false;
+				if (received.length > 0 && sender == target) {
+					dispatch(received.length);
+				} else if (received.length == SOCKET_ERROR && received.error == WSAECONNRESET) {
+					// The server port is unreachable, there is no point waiting out this attempt.
+					break;
+				}
+			}
+		}
+	} catch (...) {
+		pending.erase(requestId);
+		throw;
+	}
+	pending.erase(requestId);
+	co_return std::move(request.reply);
+}
+
+std::string CommandSession::request(const std::string& command) {
+	EventLoop loop;
+	return loop.run(requestAsync(loop, command));
+}
+
+const Socket::Address& CommandSession::getTarget() const {
+	return target;
+}
+
+void CommandSession::dispatch(int length) {
+	UdpPacket::Header header;
+	if (!UdpPacket::read(buffer.get(), length, header) || header.type != UdpPacket::Type::RESPONSE) {
+		return;
+	}
+
+	// Replies to requests that already finished, such as duplicates caused by retries, are dropped.
+	auto request = pending.find(header.seq);
+	if (request == pending.end()) {
+		return;
+	}
+	request->second->reply.assign((const char*)UdpPacket::data(buffer.get()), header.length);
+	request->second->done = true;
+}
+
@@ -0,0 +1,42 @@
+#pragma once
+#include "Socket.h"
+#include "EventLoop.h"
+#include "Task.h"
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// Client side of the command channel that keeps one socket open towards a server. Each command is sent
+// as a REQUEST with its own ID and retried with a growing timeout, and replies are matched back by ID,
+// so any number of commands may be in flight on the same session at once. While requests are in flight
+// they must all run on the same event loop.
+class CommandSession final {
+public:
+	CommandSession(WSAConnection wsaConnection, const Socket::Address& target);
+	CommandSession(const CommandSession&) = delete;
+	CommandSession& operator=(const CommandSession&) = delete;
+
+	// Resolves to the reply, or to an empty string once every attempt has timed out.
+	Task<std::string> requestAsync(EventLoop& loop, std::string command);
+	std::string request(const std::string& command);
+
+	const Socket::Address& getTarget() const;
+
+private:
+	struct PendingRequest {
+		std::string reply;
+		bool done = false;
+	};
+
+	void dispatch(int length);
+
+	Socket socket;
+	Socket::Address target;
+	std::unique_ptr<uint8_t[]> buffer;
+	std::unordered_map<uint32_t, PendingRequest*> pending;
+	uint32_t nextRequestId;
+	// Only one request reads the socket at a time and hands replies to the others.
+	bool receiving;
+};
+
@@ -0,0 +1,77 @@
+#pragma once
+#include <string_view>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "util.h"
+
+// A fixed set of text commands looked up through a perfect hash that is chosen at compile time, so
+// resolving a command costs one hash and one comparison. Command lines are parsed into views of the
+// received datagram and never copied.
+template<typename Handler, size_t N>
+class CommandTable final {
+public:
+	struct Entry {
+		std::string_view name = {};
+		Handler handler = {};
+	};
+
+	struct CommandLine {
+		std::string_view name;
+		std::string_view arguments;
+	};
+
+	static constexpr size_t SLOT_COUNT = N * 2;
+
+	consteval CommandTable(const Entry (&entries)[N]) : slots(), seed(0) {
+		// Try seeds until every name lands in its own slot.
+		for (uint32_t candidate = 1; ; ++candidate) {
+			std::array<bool, SLOT_COUNT> used = {};
+			bool collided = false;
+			for (size_t i = 0; i < N && !collided; ++i) {
+				size_t slot = hash(entries[i].name, candidate) % SLOT_COUNT;
+				collided = used[slot];
+				used[slot] = true;
+			}
+			if (!collided) {
+				seed = candidate;
+				break;
+			}
+		}
+		for (size_t i = 0; i < N; ++i) {
+			slots[hash(entries[i].name, seed) % SLOT_COUNT] = entries[i];
+		}
+	}
+
+	constexpr const Handler* find(std::string_view name) const {
+		const Entry& entry = slots[hash(name, seed) % SLOT_COUNT];
+		return !entry.name.empty() && entry.name == name ? &entry.handler : nullptr;
+	}
+
+	// Splits a line into its first word and the rest, both trimmed of surrounding whitespace.
+	static CommandLine parse(std::string_view line) {
+		line = util::trim_view(line);
+		size_t end = std::min(util::find_space(line), line.size());
+		return { line.substr(0, end), util::trim_left_view(line.substr(end)) };
+	}
+
+private:
+	static constexpr uint32_t hash(std::string_view value, uint32_t seed) {
+		uint32_t result = 2166136261u ^ seed;
+		for (char c : value) {
+			result = (result ^ (uint8_t)c) * 16777619u;
+		}
+
+		// FNV-1a leaves the low bits barely dependent on the seed, so mix before taking the slot.
+		result ^= result >> 16;
+		result *= 0x85ebca6bu;
+		result ^= result >> 13;
+		result *= 0xc2b2ae35u;
+		result ^= result >> 16;
+		return result;
+	}
+
+	std::array<Entry, SLOT_COUNT> slots;
+	uint32_t seed;
+};
@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "ContentCache.h"
+#include <fstream>
+
+namespace {
+	bool IsCurrent(const Content& content, std::filesystem::file_time_type modified, uintmax_t size) {
+		return content.modified == modified && content.size == size;
+	}
+
+	std::shared_ptr<const Content> Empty() {
+		static const std::shared_ptr<const Content> empty = std::make_shared<Content>();
+		return empty;
+	}
+}
+
+ContentCache::ContentCache(size_t capacity) : size(0), capacity(capacity), hitCount(0), missCount(0) {}
+
+std::shared_ptr<const Content> ContentCache::get(const std::string& path) {
+	std::error_code error;
+	std::filesystem::file_time_type modified = std::filesystem::last_write_time(path, error);
+	uintmax_t fileSize = error ? 0 : std::filesystem::file_size(path, error);
+	if (error || fileSize > MAX_FILE_SIZE) {
+		return Empty();
+	}
+
+	{
+		std::lock_guard<std::mutex> locked(mutex);
+		auto found = index.find(path);
+		if (found != index.end() && IsCurrent(*found->second->second, modified, fileSize)) {
+			entries.splice(entries.begin(), entries, found->second);
+			++hitCount;
+			return found->second->second;
+		}
+		++missCount;
+	}
+
+	// Read without the lock so that a slow disk only holds up the sessions that missed.
+	std::shared_ptr<Content> content = std::make_shared<Content>();
+	content->modified = modified;
+	content->size = fileSize;
+	std::ifstream ifs(path, std::ios::binary);
+	content->data.resize((size_t)fileSize);
+	ifs.read(content->data.data(), (std::streamsize)fileSize);
+	content->data.resize((size_t)ifs.gcount());
+
+	// A file changing while it is read is served as read but not cached; the next lookup reads it again.
+	if (content->data.size() != fileSize || fileSize > capacity) {
+		return content;
+	}
+
+	std::lock_guard<std::mutex> locked(mutex);
+	auto found = index.find(path);
+	if (found != index.end()) {
+		size -= found->second->second->data.size();
+		entries.erase(found->second);
+		index.erase(found);
+	}
+	entries.emplace_front(path, content);
+	index.emplace(path, entries.begin());
+	size += content->data.size();
+	evict();
+	return content;
+}
+
+void ContentCache::setCapacity(size_t capacity) {
+	std::lock_guard<std::mutex> locked(mutex);
+	this->capacity = capacity;
+	evict();
+}
+
+size_t ContentCache::getSize() const {
+	std::lock_guard<std::mutex> locked(mutex);
+	return size;
+}
+
+uint64_t ContentCache::getHitCount() const {
+	std::lock_guard<std::mutex> locked(mutex);
+	return hitCount;
+}
+
+uint64_t ContentCache::getMissCount() const {
+	std::lock_guard<std::mutex> locked(mutex);
+	return missCount;
+}
+
+void ContentCache::evict() {
+	while (size > capacity && !entries.empty()) {
+		size -= entries.back().second->data.size();
+		index.erase(entries.back().first);
+		entries.pop_back();
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <filesystem>
+#include <cstdint>
+#include <cstddef>
+
+// File contents kept in one contiguous buffer; sessions slice segments out of it for whatever data length
+// they negotiated. Never modified once loaded, so any number of sessions may read it at once.
+struct Content {
+	std::string data;
+	std::filesystem::file_time_type modified;
+	uintmax_t size;
+
+	// Changes whenever the file is reloaded with a different modification time or size, so that a client
+	// resuming an interrupted transfer does not splice two versions of the file together.
+	uint64_t version() const {
+		return (uint64_t)modified.time_since_epoch().count() * 31 + size;
+	}
+};
+
+// Least recently used cache of file contents, bounded by the total size of the files it holds. Entries are
+// checked against the modification time and size of the file on every lookup and reloaded when either
+// changed. Evicted contents stay alive for as long as a session still holds them.
+//
+// A file larger than the whole cache bypasses it: it is read in full for every lookup and freed once the
+// last session lets go of it. Files over MAX_FILE_SIZE are not served at all, so that no single request
+// can make the server read an unbounded amount.
+class ContentCache final {
+public:
+	static constexpr uintmax_t MAX_FILE_SIZE = 256 * 1024 * 1024;
+
+	explicit ContentCache(size_t capacity);
+	ContentCache(const ContentCache&) = delete;
+	ContentCache& operator=(const ContentCache&) = delete;
+
+	// The current contents of `path`. A file that cannot be read or is over MAX_FILE_SIZE gives empty
+	// content, which is not cached.
+	std::shared_ptr<const Content> get(const std::string& path);
+
+	// Shrinking the capacity evicts entries right away.
+	void setCapacity(size_t capacity);
+	size_t getSize() const;
+	uint64_t getHitCount() const;
+	uint64_t getMissCount() const;
+
+private:
+	typedef std::pair<std::string, std::shared_ptr<const Content>> Entry;
+
+	void evict();
+
+	mutable std::mutex mutex;
+	std::list<Entry> entries;					// Most recently used first.
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	size_t size;
+	size_t capacity;
+	uint64_t hitCount;
+	uint64_t missCount;
+};
@@ -0,0 +1,359 @@
+#include "stdafx.h"
+#include "sock.h"
+#include "EventLoop.h"
+#include "RegisteredIo.h"
+#include "ThreadPlacement.h"
+#include "NulException.h"
+#include <algorithm>
+#include <latch>
+
+// Upper bound on how long a loop blocks in WSAPoll, so that tasks posted from other threads are picked up.
+constexpr auto MAX_POLL_INTERVAL = std::chrono::milliseconds(10);
+// Other waits are ended by post() itself and only need a bound to keep the wait time finite.
+constexpr auto MAX_IDLE_INTERVAL = std::chrono::seconds(1);
+// Registered I/O sockets never become readable for WSAPoll, so the loop waits on the events raised by their
+// completion queues. Those that do not fit in one wait, or that are awaited next to plain sockets, are
+// checked this often instead.
+constexpr auto REGISTERED_IO_POLL_INTERVAL = std::chrono::milliseconds(1);
+// One of the handles of a wait is taken by the event that wakes the loop for posted tasks.
+constexpr size_t REGISTERED_IO_MAX_EVENTS = MAXIMUM_WAIT_OBJECTS - 1;
+
+namespace {
+	inline SOCKET& GetSocket(void* socket) {
+		return *((SOCKET*)socket);
+	}
+}
+
+EventLoop::ReceiveAwaiter::ReceiveAwaiter(EventLoop& loop, const Socket& socket, void* data, int length, 
+	Socket::Address* sender, unsigned long timeout) 
+	: loop(loop), socket(socket), data(data), length(length), sender(sender), 
+	deadline(Clock::now() + std::chrono::milliseconds(timeout)), result{ SOCKET_ERROR, WSAETIMEDOUT } {}
+
+bool EventLoop::ReceiveAwaiter::await_ready() {
+	return tryReceive();
+}
+
+void EventLoop::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	this->handle = handle;
+	loop.receivers.push_back(this);
+}
+
+EventLoop::ReceiveResult EventLoop::ReceiveAwaiter::await_resume() const {
+	return result;
+}
+
+bool EventLoop::ReceiveAwaiter::tryReceive() {
+	int res = sender ? socket.receive(data, length, *sender) : socket.receive(data, length);
+	int error = res == SOCKET_ERROR ? WSAGetLastError() : 0;
+	if (error == WSAEWOULDBLOCK) {
+		return false;
+	}
+	result = { res, error };
+	return true;
+}
+
+EventLoop::SleepAwaiter::SleepAwaiter(EventLoop& loop, unsigned long milliseconds) 
+	: loop(loop), deadline(Clock::now() + std::chrono::milliseconds(milliseconds)) {}
+
+bool EventLoop::SleepAwaiter::await_ready() const {
+	return deadline <= Clock::now();
+}
+
+void EventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	loop.timers.emplace(deadline, handle);
+}
+
+EventLoop::ConditionAwaiter::ConditionAwaiter(EventLoop& loop, std::function<bool()> condition, 
+	unsigned long timeout) 
+	: loop(loop), condition(std::move(condition)), deadline(Clock::now() + std::chrono::milliseconds(timeout)) {}
+
+bool EventLoop::ConditionAwaiter::await_ready() const {
+	return condition() || deadline <= Clock::now();
+}
+
+void EventLoop::ConditionAwaiter::await_suspend(std::coroutine_handle<> handle) {
+	this->handle = handle;
+	loop.conditions.push_back(this);
+}
+
+bool EventLoop::ConditionAwaiter::await_resume() const {
+	return condition();
+}
+
+EventLoop::EventLoop() : stopped(false), wakeEvent(CreateEventW(nullptr, FALSE, FALSE, nullptr)), waiting(false) {
+	if (wakeEvent == nullptr) {
+		throw NulException(GetLastError(), "Failed to create the wakeup event of an event loop.");
+	}
+}
+
+EventLoop::~EventLoop() {
+	CloseHandle(wakeEvent);
+}
+
+void EventLoop::runForever() {
+	while (!stopped) {
+		runOnce();
+	}
+}
+
+void EventLoop::stop() {
+	stopped = true;
+	condition.notify_all();
+	SetEvent(wakeEvent);
+}
+
+void EventLoop::setBusyPoll(unsigned long microseconds) {
+	busyPoll.setLimit(microseconds);
+}
+
+void EventLoop::spawn(Task<void> task) {
+	// A detached task has nobody to rethrow its exception to, so it is run inside a guard that catches it.
+	Task<void> guarded = guard(std::move(task));
+	std::coroutine_handle<Task<void>::promise_type> handle = std::exchange(guarded.handle, nullptr);
+	handle.promise().detached = true;
+	post(handle);
+}
+
+void EventLoop::setExceptionHandler(ExceptionHandler handler) {
+	std::lock_guard<std::mutex> locked(mutex);
+	exceptionHandler = std::move(handler);
+}
+
+Task<void> EventLoop::guard(Task<void> task) {
+	try {
+		co_await task;
+	} catch (...) {
+		ExceptionHandler handler;
+		{
+			std::lock_guard<std::mutex> locked(mutex);
+			handler = exceptionHandler;
+		}
+		if (handler) {
+			handler(std::current_exception());
+		} else if (!failure) {
+			failure = std::current_exception();
+		}
+	}
+}
+
+void EventLoop::rethrowFailure() {
+	if (failure) {
+		std::rethrow_exception(std::exchange(failure, nullptr));
+	}
+}
+
+void EventLoop::post(std::coroutine_handle<> handle) {
+	bool wake;
+	{
+		std::lock_guard<std::mutex> locked(mutex);
+		ready.push_back(handle);
+		wake = waiting;
+	}
+	condition.notify_one();
+	if (wake) {
+		SetEvent(wakeEvent);
+	}
+}
+
+EventLoop::ReceiveAwaiter EventLoop::receive(const Socket& socket, void* data, int length, unsigned long timeout) {
+	return ReceiveAwaiter(*this, socket, data, length, nullptr, timeout);
+}
+
+EventLoop::ReceiveAwaiter EventLoop::receive(const Socket& socket, void* data, int length, Socket::Address& sender,
+	unsigned long timeout) {
+	return ReceiveAwaiter(*this, socket, data, length, &sender, timeout);
+}
+
+EventLoop::SleepAwaiter EventLoop::sleep(unsigned long milliseconds) {
+	return SleepAwaiter(*this, milliseconds);
+}
+
+EventLoop::ConditionAwaiter EventLoop::until(std::function<bool()> condition, unsigned long timeout) {
+	return ConditionAwaiter(*this, std::move(condition), timeout);
+}
+
+void EventLoop::runOnce() {
+	// 1. Run everything that became ready since the last round.
+	std::deque<std::coroutine_handle<>> batch;
+	{
+		std::lock_guard<std::mutex> locked(mutex);
+		batch.swap(ready);
+	}
+	for (std::coroutine_handle<> handle : batch) {
+		handle.resume();
+	}
+	rethrowFailure();
+
+	// 2. Wait for the earliest socket, timer or deadline.
+	Clock::time_point now = Clock::now();
+	Clock::time_point wakeup = now + MAX_IDLE_INTERVAL;
+	if (!timers.empty()) {
+		wakeup = std::min(wakeup, timers.begin()->first);
+	}
+	for (const ConditionAwaiter* waiter : conditions) {
+		wakeup = std::min(wakeup, waiter->condition() ? now : waiter->deadline);
+	}
+	std::vector<WSAPOLLFD> fds;
+	std::vector<HANDLE> events;
+	bool eventsOverflow = false;
+	for (const ReceiveAwaiter* receiver : receivers) {
+		wakeup = std::min(wakeup, receiver->deadline);
+		if (receiver->socket.isRegisteredIo()) {
+			HANDLE event = receiver->socket.registeredIo->notify();
+			if (event == nullptr) {
+				wakeup = now;
+			} else if (std::find(events.begin(), events.end(), event) != events.end()) {
+				// Several receives may wait on the same socket.
+			} else if (events.size() < REGISTERED_IO_MAX_EVENTS) {
+				events.push_back(event);
+			} else {
+				eventsOverflow = true;
+			}
+			continue;
+		}
+		WSAPOLLFD fd;
+		fd.fd = GetSocket(receiver->socket.socket);
+		fd.events = POLLRDNORM;
+		fd.revents = 0;
+		fds.push_back(fd);
+	}
+	if (!fds.empty()) {
+		wakeup = std::min(wakeup, now + MAX_POLL_INTERVAL);
+	}
+	if (eventsOverflow || (!events.empty() && !fds.empty())) {
+		wakeup = std::min(wakeup, now + REGISTERED_IO_POLL_INTERVAL);
+	}
+	auto wait = std::chrono::ceil<std::chrono::milliseconds>(std::max(wakeup - now, Clock::duration::zero()));
+
+	if (!events.empty() && fds.empty()) {
+		// Tasks posted while the loop is blocked here raise the wakeup event, which post() only does while
+		// `waiting` is set.
+		std::unique_lock<std::mutex> locked(mutex);
+		if (ready.empty() && !stopped) {
+			waiting = true;
+			locked.unlock();
+			events.push_back(wakeEvent);
+			WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, (DWORD)wait.count());
+			locked.lock();
+			waiting = false;
+		}
+	} else if (fds.empty()) {
+		std::unique_lock<std::mutex> locked(mutex);
+		condition.wait_for(locked, wait, [this]() { return !ready.empty() || stopped; });
+	} else if (!busyPoll.spin([&fds]() { return WSAPoll(fds.data(), (unsigned long)fds.size(), 0) > 0; }, wakeup)) {
+		wait = std::chrono::ceil<std::chrono::milliseconds>(std::max(wakeup - Clock::now(), Clock::duration::zero()));
+		WSAPoll(fds.data(), (unsigned long)fds.size(), (int)wait.count());
+	}
+
+	// 3. Collect the waiters that can continue before resuming any of them, since resumed coroutines
+	// register new waiters.
+	std::vector<std::coroutine_handle<>> resumed;
+	now = Clock::now();
+	size_t kept = 0, polled = 0;
+	for (size_t i = 0; i < receivers.size(); ++i) {
+		ReceiveAwaiter* receiver = receivers[i];
+		bool readable = receiver->socket.isRegisteredIo() || fds[polled++].revents != 0;
+		if ((readable && receiver->tryReceive()) || receiver->deadline <= now) {
+			resumed.push_back(receiver->handle);
+		} else {
+			receivers[kept++] = receiver;
+		}
+	}
+	receivers.resize(kept);
+
+	kept = 0;
+	for (size_t i = 0; i < conditions.size(); ++i) {
+		ConditionAwaiter* waiter = conditions[i];
+		if (waiter->condition() || waiter->deadline <= now) {
+			resumed.push_back(waiter->handle);
+		} else {
+			conditions[kept++] = waiter;
+		}
+	}
+	conditions.resize(kept);
+
+	while (!timers.empty() && timers.begin()->first <= now) {
+		resumed.push_back(timers.begin()->second);
+		timers.erase(timers.begin());
+	}
+
+	for (std::coroutine_handle<> handle : resumed) {
+		handle.resume();
+	}
+	rethrowFailure();
+}
+
+EventLoopPool::EventLoopPool(size_t threadCount, const std::vector<unsigned>& processors) : nextLoop(0) {
+	if (threadCount == 0) {
+		threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+	loops.resize(threadCount);
+	pinned = std::make_unique<bool[]>(threadCount);
+	std::vector<std::exception_ptr> failures(threadCount);
+	std::latch created((std::ptrdiff_t)threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back([this, i, &processors, &failures, &created]() {
+			// Pinned before anything is allocated, the loop itself included.
+			if (!processors.empty()) {
+				pinned[i] = ThreadPlacement::pin(processors[i % processors.size()]);
+			}
+			try {
+				loops[i] = std::make_unique<EventLoop>();
+			} catch (...) {
+				failures[i] = std::current_exception();
+			}
+			EventLoop* loop = loops[i].get();
+			created.count_down();
+			if (loop != nullptr) {
+				loop->runForever();
+			}
+		});
+	}
+	created.wait();
+
+	for (std::exception_ptr& failure : failures) {
+		if (failure) {
+			shutdown();
+			std::rethrow_exception(failure);
+		}
+	}
+}
+
+EventLoopPool::~EventLoopPool() {
+	shutdown();
+}
+
+void EventLoopPool::shutdown() {
+	for (std::unique_ptr<EventLoop>& loop : loops) {
+		if (loop) {
+			loop->stop();
+		}
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+EventLoop& EventLoopPool::next() {
+	return *loops[nextLoop++ % loops.size()];
+}
+
+size_t EventLoopPool::size() const {
+	return loops.size();
+}
+
+bool EventLoopPool::isPinned(size_t index) const {
+	return pinned[index];
+}
+
+void EventLoopPool::setBusyPoll(unsigned long microseconds) {
+	for (std::unique_ptr<EventLoop>& loop : loops) {
+		loop->setBusyPoll(microseconds);
+	}
+}
+
+void EventLoopPool::setExceptionHandler(EventLoop::ExceptionHandler handler) {
+	for (std::unique_ptr<EventLoop>& loop : loops) {
+		loop->setExceptionHandler(handler);
+	}
+}
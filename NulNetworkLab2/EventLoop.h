@@ -0,0 +1,171 @@
+#pragma once
+#include "Socket.h"
+#include "Task.h"
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <exception>
+
+// Single-threaded scheduler for Task coroutines. Coroutines waiting on a socket or a timer are resumed
+// by whichever thread drives the loop through run() or runForever(). Awaitables handed out by a loop
+// must be awaited from a coroutine running on that loop, and sockets passed to receive() must be in
+// non-blocking mode.
+class EventLoop final {
+public:
+	typedef std::chrono::steady_clock Clock;
+	typedef std::function<void(std::exception_ptr)> ExceptionHandler;
+
+	EventLoop();
+	EventLoop(const EventLoop&) = delete;
+	EventLoop& operator=(const EventLoop&) = delete;
+	~EventLoop();
+
+	// The received length, or SOCKET_ERROR and the error that ended the receive. The error is read as soon
+	// as the receive fails, since WSAGetLastError() may have been changed by other sockets of the loop by
+	// the time the coroutine resumes.
+	struct ReceiveResult {
+		int length;
+		int error;
+	};
+
+	class ReceiveAwaiter final {
+	public:
+		bool await_ready();
+		void await_suspend(std::coroutine_handle<> handle);
+		ReceiveResult await_resume() const;
+
+	private:
+		ReceiveAwaiter(EventLoop& loop, const Socket& socket, void* data, int length, Socket::Address* sender,
+			unsigned long timeout);
+		bool tryReceive();
+
+		EventLoop& loop;
+		const Socket& socket;
+		void* data;
+		int length;
+		Socket::Address* sender;
+		Clock::time_point deadline;
+		std::coroutine_handle<> handle;
+		ReceiveResult result;
+		friend class EventLoop;
+	};
+
+	class SleepAwaiter final {
+	public:
+		bool await_ready() const;
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() const {}
+
+	private:
+		SleepAwaiter(EventLoop& loop, unsigned long milliseconds);
+
+		EventLoop& loop;
+		Clock::time_point deadline;
+		friend class EventLoop;
+	};
+
+	class ConditionAwaiter final {
+	public:
+		bool await_ready() const;
+		void await_suspend(std::coroutine_handle<> handle);
+		bool await_resume() const;
+
+	private:
+		ConditionAwaiter(EventLoop& loop, std::function<bool()> condition, unsigned long timeout);
+
+		EventLoop& loop;
+		std::function<bool()> condition;
+		Clock::time_point deadline;
+		std::coroutine_handle<> handle;
+		friend class EventLoop;
+	};
+
+	// Drives the loop on the calling thread until `task` finishes, then returns its result.
+	template<typename T>
+	T run(Task<T> task) {
+		post(task.handle);
+		while (!task.handle.done()) {
+			runOnce();
+		}
+		return task.handle.promise().result();
+	}
+
+	void runForever();
+	void stop();
+	// Opt-in: spin on the sockets for up to this many microseconds before blocking in WSAPoll. May be
+	// called from any thread.
+	void setBusyPoll(unsigned long microseconds);
+
+	// Starts a task that owns itself and is freed once it finishes. May be called from any thread.
+	void spawn(Task<void> task);
+	// Receives the exceptions that escape spawned tasks, on the thread driving the loop. Without a handler
+	// they are rethrown from run() or runForever(). May be called from any thread.
+	void setExceptionHandler(ExceptionHandler handler);
+	void post(std::coroutine_handle<> handle);
+
+	// Resolves to the received length, or to SOCKET_ERROR and WSAETIMEDOUT if nothing arrived within
+	// `timeout` milliseconds.
+	ReceiveAwaiter receive(const Socket& socket, void* data, int length, unsigned long timeout);
+	ReceiveAwaiter receive(const Socket& socket, void* data, int length, Socket::Address& sender, 
+		unsigned long timeout);
+	SleepAwaiter sleep(unsigned long milliseconds);
+	// Resolves once `condition` holds, or after `timeout` milliseconds, to the value of `condition`. The
+	// condition is checked after every round, so it must only depend on tasks running on this loop.
+	ConditionAwaiter until(std::function<bool()> condition, unsigned long timeout);
+
+private:
+	void runOnce();
+	Task<void> guard(Task<void> task);
+	void rethrowFailure();
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<std::coroutine_handle<>> ready;
+	std::vector<ReceiveAwaiter*> receivers;
+	std::vector<ConditionAwaiter*> conditions;
+	std::multimap<Clock::time_point, std::coroutine_handle<>> timers;
+	std::atomic_bool stopped;
+	BusyPoll busyPoll;
+	ExceptionHandler exceptionHandler;
+	std::exception_ptr failure;						// Left by a spawned task that had no handler.
+	void* wakeEvent;								// Raised by post() while the loop waits on registered I/O.
+	bool waiting;
+};
+
+// A fixed set of event loops, each driven by its own thread. Tasks are spread across the loops in turn;
+// any task still suspended when the pool is destroyed is abandoned.
+class EventLoopPool final {
+public:
+	// The i-th thread pins itself to entry i modulo `processors`, if any, before it creates its loop, so
+	// that the loop and everything it allocates live on the NUMA node of that processor. Returns once
+	// every loop exists.
+	explicit EventLoopPool(size_t threadCount = 0, const std::vector<unsigned>& processors = {});
+	EventLoopPool(const EventLoopPool&) = delete;
+	EventLoopPool& operator=(const EventLoopPool&) = delete;
+	~EventLoopPool();
+
+	EventLoop& next();
+	size_t size() const;
+	void setBusyPoll(unsigned long microseconds);
+	// See EventLoop::setExceptionHandler. Pools should always have one: an exception rethrown from the
+	// thread of a loop ends the process.
+	void setExceptionHandler(EventLoop::ExceptionHandler handler);
+	// Whether the thread of the `index`-th loop managed to pin itself; see ThreadPlacement::pin.
+	bool isPinned(size_t index) const;
+
+private:
+	void shutdown();
+
+	std::vector<std::unique_ptr<EventLoop>> loops;
+	std::vector<std::thread> threads;
+	std::unique_ptr<bool[]> pinned;
+	std::atomic<size_t> nextLoop;
+};
+
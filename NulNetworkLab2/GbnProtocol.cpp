@@ -3,18 +3,24 @@
 #include <memory>
 #include <format>
 #include <cstdint>
+#include <algorithm>
 #include "util.h"
+#include "UdpPacket.h"
+#include "PacketPool.h"
 #include <random>
 
-constexpr size_t GBN_BUFFER_LENGTH = 1026;
+constexpr size_t GBN_BUFFER_LENGTH = UdpPacket::MAX_LENGTH;
 constexpr size_t GBN_SEQ_SIZE = 20;
-constexpr size_t GBN_DATA_LENGTH = 1024;
+constexpr size_t GBN_DATA_LENGTH = UdpPacket::MAX_DATA_LENGTH;
 constexpr size_t GBN_MAX_END_ATTEMPT = 5;
+constexpr size_t GBN_MAX_HANDSHAKE_ATTEMPT = 5;
+constexpr size_t GBN_MAX_IDLE_COUNT = 20;
+constexpr size_t GBN_MAX_SERVER_IDLE_COUNT = 60;
+constexpr unsigned long GBN_RECEIVE_TIMEOUT = 1000;
 constexpr int SEND_WINDOW_SIZE = 10;
 
 enum class GbnStage {
 	CHECK_STATUS,
-	WAIT_FOR_RESPONSE,
 	DATA_TRANSMISSION,
 	CLOSED
 };
@@ -22,10 +28,16 @@ enum class GbnStage {
 struct GbnStatus {
 	uint8_t curSeq, curAck;			// ǰźѾȷϵк
 	uint32_t totalSeq, waitCount;	// ѾϵкԼʱʱ
+	uint32_t sentSeq;				// ͹кش
+	uint32_t idleCount;				// ûյ Ack Ĵ
 	bool end;						// ǷѾе
 	uint8_t endAttempt;				// ͽݰĴ
+	uint16_t windowSize;			// Э̺ķʹڴС
+	uint32_t windowNext;			// շͨѾ˳յݰ
+	uint32_t windowEnd;				// շͨĴұ߽磬֮ǰݰſԷ
+	bool confirmed;					// ǷѾյͻ˵ Ack
 	
-	GbnStatus() {
+	GbnStatus(uint16_t windowSize) : windowSize(windowSize) {
 		clear();
 	}
 
@@ -37,91 +49,167 @@ struct GbnStatus {
 			step += GBN_SEQ_SIZE;
 		}
 
-		// 2. Ƿ˶
-		return step < SEND_WINDOW_SIZE;
+		// 2. Ƿ˶ԼշǷпռ䣻ûпռʱֻһݰ̽ⴰǷ´
+		return step < windowSize && (totalSeq < windowEnd || step == 0);
+	}
+
+	// ½շͨĴڣ򵽴ľͨ治Ḳµ
+	void advertise(uint32_t next, uint16_t window) {
+		if (next >= windowNext) {
+			windowNext = next;
+			windowEnd = next + window;
+		}
 	}
 
 	void clear() {
 		curSeq = 0;
 		curAck = 0;
 		totalSeq = 0;
+		sentSeq = 0;
 		waitCount = 0;
+		idleCount = 0;
 		end = false;
 		endAttempt = 0;
+		windowNext = 0;
+		windowEnd = UINT32_MAX;
+		confirmed = false;
 	}
 };
 
-GbnProtocol::GbnProtocol(WSAConnection wsaConnection) : UdpReliableProtocol(wsaConnection) {}
+GbnProtocol::GbnProtocol(WSAConnection wsaConnection) 
+	: UdpReliableProtocol(wsaConnection, { UdpPacket::Protocol::GBN, SEND_WINDOW_SIZE, GBN_DATA_LENGTH }) {}
 
-void GbnProtocol::response(const Socket& socket, const Socket::Address& target, const std::string& data) {
-	GbnStatus status;
+Task<void> GbnProtocol::responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+	const std::string& data) {
+	UdpPacket::Parameters accepted = negotiate(GBN_SEQ_SIZE - 1, GBN_DATA_LENGTH, data.size());
+	GbnStatus status(accepted.windowSize);
 	GbnStage stage = GbnStage::CHECK_STATUS;
 	Socket::Address sender;
-	std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(GBN_BUFFER_LENGTH);
+	PacketBuffer buffer = PacketPool::local().acquire();
+	// ű͵ݰֱ֮·ͣСſռ䣬µݰͬһʱɵһѾȷ
+	PacketBuffer segments[GBN_SEQ_SIZE + 1];
+	UdpPacket::Header header;
+	uint32_t next = 0;
+	uint16_t window = 0;
+	bool acked = false;
 	int res = 0;
+	PacketTracer::Event event = PacketTracer::Event::SEND;
 
 	while (stage != GbnStage::CLOSED) {
 		switch (stage) {
 		case GbnStage::CHECK_STATUS:
-			buffer[0] = 205;
-			socket.send(buffer.get(), 1, target);
-			logger("[Server] Sent handshake request.");
-			stage = GbnStage::WAIT_FOR_RESPONSE;
-			break;
-		case GbnStage::WAIT_FOR_RESPONSE:
-			res = socket.receive(buffer.get(), GBN_BUFFER_LENGTH);
-			if (res <= 0) {
-				++status.waitCount;
-				if (status.waitCount > 20) {
-					stage = GbnStage::CLOSED;
-					logger("[Server] Timeout error.");
-				}
-				util::sleep(500);
-			} else if (buffer[0] == 200) {
-				logger("[Server] Begin file transmission.");
-				status.clear();
-				stage = GbnStage::DATA_TRANSMISSION;
-			}
+			// ȷϴֱӷ͵һڵݣȴͻ˻Ӧ
+			res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+			trace(PacketTracer::Side::SERVER, PacketTracer::Event::SEND, accepted.transferId, 0, res, 
+				UdpPacket::Type::HANDSHAKE_ACK);
+			socket.send(buffer.get(), res, target);
+			logger(std::format("[Server] Accepted transfer {} at offset {}, window size {}, data length {}.", 
+				accepted.transferId, accepted.offset, accepted.windowSize, accepted.dataLength));
+			stage = GbnStage::DATA_TRANSMISSION;
 			break;
 		case GbnStage::DATA_TRANSMISSION:
-			if (status.isSeqAvailable()) {
+			while (!status.end && status.isSeqAvailable()) {
 
-				// ȡǰȡݵƫ
-				size_t offset = GBN_DATA_LENGTH * status.totalSeq;
+				// ȡǰȡݵƫƣ֮ٴη͵кŶش
+				size_t offset = (size_t)accepted.offset + (size_t)accepted.dataLength * status.totalSeq;
+				event = status.totalSeq < status.sentSeq ? PacketTracer::Event::RETRANSMIT : PacketTracer::Event::SEND;
 				
-				// ǷϣϣͿݰ
+				// Ƿϣϣͽݰ
 				if (offset < data.size()) {
 					//  Seq ŷװݰ
-					std::memset(buffer.get(), 0, GBN_BUFFER_LENGTH);
-					buffer[0] = (uint8_t)++status.curSeq;
+					++status.curSeq;
 					if (status.curSeq > GBN_SEQ_SIZE) {
 						status.curSeq -= GBN_SEQ_SIZE;
 					}
-					std::string send = data.substr(offset, GBN_DATA_LENGTH);
-					std::memcpy(&buffer[1], send.c_str(), send.size());
+					PacketBuffer& segment = segments[status.curSeq];
+					if (event == PacketTracer::Event::SEND || !segment) {
+						size_t length = std::min<size_t>(accepted.dataLength, data.size() - offset);
+						segment = PacketPool::local().acquire();
+						segment.setSize(UdpPacket::write(segment.get(), UdpPacket::Type::DATA, status.curSeq, 
+							data.data() + offset, length));
+					}
 					++status.totalSeq;
 					logger(std::format("[Server] Sent data package seq {}", status.curSeq));
-					socket.send(buffer.get(), GBN_BUFFER_LENGTH, target);
+					trace(PacketTracer::Side::SERVER, event, accepted.transferId, status.curSeq, segment.size(), 
+						UdpPacket::Type::DATA);
+					socket.send(segment.get(), segment.size(), target);
 				} else {
-					if (!status.end) {
-						std::memset(buffer.get(), 0, GBN_BUFFER_LENGTH);
-						status.end = true;
-						buffer[0] = ++status.curSeq;
-						++status.totalSeq;
-						logger(std::format("[Server] Sent end package seq {}", status.curSeq));
-						socket.send(buffer.get(), GBN_BUFFER_LENGTH, target);
+					status.end = true;
+					++status.curSeq;
+					if (status.curSeq > GBN_SEQ_SIZE) {
+						status.curSeq -= GBN_SEQ_SIZE;
+					}
+					++status.totalSeq;
+					PacketBuffer& segment = segments[status.curSeq];
+					if (event == PacketTracer::Event::SEND || !segment) {
+						segment = PacketPool::local().acquire();
+						segment.setSize(UdpPacket::write(segment.get(), UdpPacket::Type::END, status.curSeq));
+					}
+					logger(std::format("[Server] Sent end package seq {}", status.curSeq));
+					trace(PacketTracer::Side::SERVER, event, accepted.transferId, status.curSeq, segment.size(), 
+						UdpPacket::Type::END);
+					socket.send(segment.get(), segment.size(), target);
+				}
+				status.sentSeq = std::max(status.sentSeq, status.totalSeq);
+			}
+
+			// տͻ˷ Ack ݰ
+			acked = false;
+			while ((res = socket.receive(buffer.get(), GBN_BUFFER_LENGTH, sender)) > 0) {
+				if (!UdpPacket::read(buffer.get(), res, header)) {
+					continue;
+				}
+
+				// ͻ˴ݰ֪ѾʼûյֻӦ·
+				if (header.type == UdpPacket::Type::HANDSHAKE) {
+					UdpPacket::Parameters request;
+					if (UdpPacket::readParameters(buffer.get(), header, request) && 
+						request.transferId == accepted.transferId) {
+						res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+						trace(PacketTracer::Side::SERVER, PacketTracer::Event::RETRANSMIT, accepted.transferId, 0, res, 
+							UdpPacket::Type::HANDSHAKE_ACK);
+						socket.send(buffer.get(), res, target);
 					}
+					continue;
+				}
+				if (header.type != UdpPacket::Type::ACK) {
+					continue;
+				}
+
+				// յ Ack 
+				uint8_t ack = (uint8_t)header.seq;
+				trace(PacketTracer::Side::SERVER, PacketTracer::Event::RECEIVE, accepted.transferId, ack, res, 
+					UdpPacket::Type::ACK);
+				if (UdpPacket::readWindow(buffer.get(), header, next, window)) {
+					status.advertise(next, window);
+				}
+				status.curAck = ack;
+				status.waitCount = 0;
+				status.confirmed = true;
+				acked = true;
+				logger(std::format("[Server] Received ack {}", ack));
+				if (status.curAck == status.curSeq && status.end) {
+					stage = GbnStage::CLOSED;
+					break;
 				}
 			}
 
-			// տͻ˷ Ack ݰ
-			res = socket.receive(buffer.get(), GBN_BUFFER_LENGTH, sender);
+			// ͻ˳ʱûлӦ䣬һֱռù߳
+			if (acked) {
+				status.idleCount = 0;
+			} else if (++status.idleCount >= GBN_MAX_SERVER_IDLE_COUNT) {
+				logger("[Server] Client is not responding, terminating connection");
+				stage = GbnStage::CLOSED;
+				break;
+			}
 
-			if (res <= 0) {
+			if (!acked) {
 				++status.waitCount;
 				if (status.waitCount >= 10) {
 					// ʱ˵ϸ Ack һ֡
 					logger("[Server] Timeout error, go back to last ack");
+					trace(PacketTracer::Side::SERVER, PacketTracer::Event::TIMEOUT, accepted.transferId, 
+						status.curAck % GBN_SEQ_SIZE + 1, 0, UdpPacket::Type::DATA);
 					int step = (int)status.curSeq - status.curAck;
 					if (step < 0) {
 						step += GBN_SEQ_SIZE;
@@ -144,19 +232,18 @@ void GbnProtocol::response(const Socket& socket, const Socket::Address& target,
 							GBN_MAX_END_ATTEMPT - status.endAttempt));
 					}
 					status.end = false;
-				}
-			} else {
-				// յ Ack 
-				uint8_t ack = buffer[0];
-				status.curAck = ack;
-				status.waitCount = 0;
-				logger(std::format("[Server] Received ack {}", ack));
-				if (status.curAck == status.curSeq && status.end) {
-					stage = GbnStage::CLOSED;
+
+					// ͻ˻ûлӦֻӦѾʧ·
+					if (!status.confirmed) {
+						res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+						trace(PacketTracer::Side::SERVER, PacketTracer::Event::RETRANSMIT, accepted.transferId, 0, res, 
+							UdpPacket::Type::HANDSHAKE_ACK);
+						socket.send(buffer.get(), res, target);
+					}
 				}
 			}
 
-			util::sleep(500);
+			co_await loop.sleep(500);
 
 			break;
 		}
@@ -165,7 +252,8 @@ void GbnProtocol::response(const Socket& socket, const Socket::Address& target,
 	logger("[Server] Test GBN protocol end");
 }
 
-std::string GbnProtocol::receive(const std::string& host, unsigned short port, double loss, double ackLoss) {
+Task<bool> GbnProtocol::transferAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+	double ackLoss, std::string& result) {
 	Socket socket(wsaConnection);
 	socket.init(Socket::ProtocolType::UDP);
 	Socket::Address sender, target(host, port);
@@ -173,61 +261,119 @@ std::string GbnProtocol::receive(const std::string& host, unsigned short port, d
 	std::default_random_engine engine(randomDevice());
 	std::bernoulli_distribution randomLoss(loss), randomAckLoss(ackLoss);
 	GbnStage stage = GbnStage::CHECK_STATUS;
-	std::string result;
-	std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(GBN_BUFFER_LENGTH);
+	PacketBuffer buffer = PacketPool::local().acquire();
+	UdpPacket::Header header;
 	int res = 0;
+	size_t handshakeAttempt = 1, idleCount = 0;
+	uint64_t offset = result.size();
+	bool finished = false, handshakeLost = false;
 	uint8_t seq = 0, ack = 0;
+	uint32_t delivered = 0;
+	// ֻӦʧʱЭ̵Ĺ㴰ڴС
+	uint16_t windowSize = std::clamp<uint16_t>(parameters.windowSize, 1, (uint16_t)(GBN_SEQ_SIZE - 1));
 
-	socket.send("-testgbn", target);
+	socket.setBlockMode(false);
+	sendHandshake(socket, target, buffer.get(), offset);
 
 	while (stage != GbnStage::CLOSED) {
-		res = socket.receive(buffer.get(), GBN_BUFFER_LENGTH);
+		res = (co_await loop.receive(socket, buffer.get(), GBN_BUFFER_LENGTH, sender, GBN_RECEIVE_TIMEOUT)).length;
 		if (res <= 0) {
+			// Ӧʧ·
+			if (stage == GbnStage::CHECK_STATUS) {
+				if (handshakeAttempt >= GBN_MAX_HANDSHAKE_ATTEMPT) {
+					logger("[Client] Handshake timeout");
+					stage = GbnStage::CLOSED;
+				} else {
+					++handshakeAttempt;
+					sendHandshake(socket, target, buffer.get(), offset);
+				}
+			} else if (++idleCount >= GBN_MAX_IDLE_COUNT) {
+				// ʱûзݣδ䣬Ժѽյλü
+				logger("[Client] Transfer timeout");
+				stage = GbnStage::CLOSED;
+			}
 			continue;
 		}
+		if (!UdpPacket::read(buffer.get(), res, header)) {
+			continue;
+		}
+		idleCount = 0;
 
-		switch (stage) {
-		case GbnStage::CHECK_STATUS:
-			if (buffer[0] == 205) {
-				buffer[0] = 200;
-				socket.send(buffer.get(), 1, target);
+		// µĴУֻӦܶʧʱյݰͬʾѾ˴
+		// ʱȴֻӦȷϷʼ͵λ
+		// Ϊÿδʹõ׽֣֮ Ack ͵ӦԴ
+		if (stage == GbnStage::CHECK_STATUS) {
+			if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, header.seq, res, header.type);
+				UdpPacket::Parameters accepted;
+				if (acceptHandshake(buffer.get(), header, result, accepted)) {
+					windowSize = accepted.windowSize;
+					stage = GbnStage::DATA_TRANSMISSION;
+					target = sender;
+				}
+				continue;
+			}
+			if (offset == 0 && (header.type == UdpPacket::Type::DATA || header.type == UdpPacket::Type::END)) {
 				stage = GbnStage::DATA_TRANSMISSION;
+				target = sender;
+				handshakeLost = true;
 			}
-			break;
+		} else if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+			// ٵֻӦֻ¼ݵܳȺͰ汾жܴ֮ѽյλü
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, header.seq, res, header.type);
+			recordHandshake(buffer.get(), header);
+			continue;
+		}
+
+		switch (stage) {
 		case GbnStage::DATA_TRANSMISSION:
-			seq = buffer[0];
+			if (header.type != UdpPacket::Type::DATA && header.type != UdpPacket::Type::END) {
+				break;
+			}
+			seq = (uint8_t)header.seq;
 			logger(std::format("[Client] Received data package seq {}", seq));
 			if (randomLoss(engine)) {
 				logger(std::format("[Client] Lost package {}", seq));
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::DROP, transferId, seq, res, header.type);
 				break;
 			}
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, seq, res, header.type);
 
 			// 
 			if (seq == ack + 1 || (ack == GBN_SEQ_SIZE && seq == 1)) {
 				ack = seq;
-				std::string received((char*)&buffer[1]);
-				result += received;
+				++delivered;
+				result.append((const char*)UdpPacket::data(buffer.get()), header.length);
 				logger(std::format("[Client] Accepted package seq {}, length {}", 
-					seq, received.size()));
+					seq, header.length));
 
-				if (received.empty()) {
+				if (header.type == UdpPacket::Type::END) {
 					logger("[Client] End file transmission");
+					finished = true;
 					stage = GbnStage::CLOSED;
 				}
 			}
+			// ûлݰֻȡӦûûȡߵ
+			res = UdpPacket::writeAck(buffer.get(), ack, delivered, receiveWindow(windowSize));
 			if (randomAckLoss(engine)) {
 				logger(std::format("[Client] Lost ack {}", ack));
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::DROP, transferId, ack, res, UdpPacket::Type::ACK);
 				break;
 			}
-			std::memset(buffer.get(), 0, GBN_BUFFER_LENGTH);
-			buffer[0] = ack;
-			socket.send(buffer.get(), GBN_BUFFER_LENGTH, target);
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::SEND, transferId, ack, res, UdpPacket::Type::ACK);
+			socket.send(buffer.get(), res, target);
 			logger(std::format("[Client] Sent ack {}", ack));
 			break;
 		}
+
+		// ֻӦʧˣʹõ׽һΣյ·ֻӦ
+		if (handshakeLost && stage != GbnStage::CLOSED) {
+			handshakeLost = false;
+			sendHandshake(socket, target, buffer.get(), offset);
+		}
 	}
 
-	return result;
+	co_return finished;
 }
 
 
@@ -6,7 +6,11 @@ class GbnProtocol : public UdpReliableProtocol {
 public:
 	GbnProtocol(WSAConnection wsaConnection);
 
-	virtual void response(const Socket& socket, const Socket::Address& target, const std::string& data) override;
-	virtual std::string receive(const std::string& host, unsigned short port, double loss, double ackLoss) override;
+	virtual Task<void> responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+		const std::string& data) override;
+
+protected:
+	virtual Task<bool> transferAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+		double ackLoss, std::string& result) override;
 };
 
@@ -0,0 +1,356 @@
+#include "stdafx.h"
+#include "MulticastProtocol.h"
+#include <format>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <set>
+#include "util.h"
+#include "PacketPool.h"
+
+constexpr size_t MULTICAST_BUFFER_LENGTH = UdpPacket::MAX_LENGTH;
+constexpr size_t MULTICAST_DATA_LENGTH = UdpPacket::MAX_DATA_LENGTH;
+// ÿһ෢͵ݰ
+constexpr uint16_t MULTICAST_BURST = 32;
+constexpr uint16_t MULTICAST_MAX_BURST = 256;
+constexpr unsigned long MULTICAST_TICK = 20;
+// һ NAK ֮ȴʱ䣬ڼнշݰϲΪһ޸
+constexpr unsigned long MULTICAST_REPAIR_INTERVAL = 100;
+constexpr unsigned long MULTICAST_HEARTBEAT_INTERVAL = 200;
+// ݷ֮ôûյ NAK ͽ
+constexpr uint32_t MULTICAST_LINGER_COUNT = 10;
+// շȱʧ֮ȴʱ䣬ȷ͵ NAK ͷת֮շ NAK
+constexpr unsigned long MULTICAST_NAK_BACKOFF = 50;
+// ݰû޸ʱٴļ
+constexpr unsigned long MULTICAST_NAK_RETRY = 300;
+constexpr unsigned long MULTICAST_RECEIVE_TIMEOUT = 200;
+// շôûյκݰͷ
+constexpr unsigned long MULTICAST_MAX_SILENCE = 5000;
+// շܵݰûо֤ܰеĳֱӷڴ
+constexpr uint64_t MULTICAST_MAX_TOTAL_LENGTH = 256 * 1024 * 1024;
+constexpr uint64_t MULTICAST_MAX_SEGMENT_COUNT = 1024 * 1024;
+
+typedef EventLoop::Clock Clock;
+
+struct MulticastStatus {
+	uint32_t segmentCount;							// ݰ
+	uint32_t sent;									// Ѿ͵ݰ
+	std::set<uint32_t> repairs;						// ȴ޸ݰշͬһݰʱֻ޸һ
+	Clock::time_point repairDeadline;				// һ޸͵ʱ
+	uint32_t quietCount;							// ûյ NAK 
+	uint64_t nakCount;								// յ NAK 
+	uint64_t confirmCount;							// תݰ
+	uint64_t repairCount;							// ޸͵ݰ
+
+	MulticastStatus(uint32_t segmentCount)
+		: segmentCount(segmentCount), sent(0), quietCount(0), nakCount(0), confirmCount(0), repairCount(0) {}
+};
+
+struct MulticastReceiveStatus {
+	UdpPacket::Parameters accepted;					// ͷĲ
+	Socket::Address source;							// ͷĵַNAK ͵
+	bool announced;									// ǷѾյͷ
+	std::vector<std::string> segments;				// յ
+	std::vector<bool> received;						// ݰǷѾյ
+	uint32_t receivedCount;							// Ѿյݰ
+	uint32_t known;									// ֪ͷѾ͵ݰ
+	std::map<uint32_t, Clock::time_point> missing;	// ȱʧݰһʱ
+	uint64_t nakCount;								// ͵ NAK 
+	uint64_t suppressedCount;						// ΪշѾƳٵݰ
+
+	MulticastReceiveStatus() : announced(false), receivedCount(0), known(0), nakCount(0), suppressedCount(0) {}
+
+	bool finished() const {
+		return announced && receivedCount == segments.size();
+	}
+
+	static bool IsAcceptable(const UdpPacket::Parameters& parameters) {
+		if (parameters.dataLength == 0 || parameters.dataLength > MULTICAST_DATA_LENGTH ||
+			parameters.totalLength > MULTICAST_MAX_TOTAL_LENGTH) {
+			return false;
+		}
+		uint64_t count = (parameters.totalLength + parameters.dataLength - 1) / parameters.dataLength;
+		return count <= MULTICAST_MAX_SEGMENT_COUNT;
+	}
+
+	void announce(const UdpPacket::Parameters& parameters, const Socket::Address& sender) {
+		accepted = parameters;
+		source = sender;
+		announced = true;
+		size_t count = (size_t)((parameters.totalLength + parameters.dataLength - 1) / parameters.dataLength);
+		segments.resize(count);
+		received.resize(count);
+	}
+
+	// ͷѾ count ݰлûյĶΪȱʧ
+	void discover(uint32_t count, Clock::time_point deadline) {
+		count = std::min<uint32_t>(count, (uint32_t)segments.size());
+		for (; known < count; ++known) {
+			if (!received[known]) {
+				missing.emplace(known, deadline);
+			}
+		}
+	}
+
+	void accept(uint32_t seq, const uint8_t* data, uint16_t length) {
+		if (seq >= segments.size() || received[seq]) {
+			return;
+		}
+		segments[seq].assign((const char*)data, length);
+		received[seq] = true;
+		++receivedCount;
+		missing.erase(seq);
+	}
+
+	// շѾЩݰƳԼ
+	void suppress(const std::vector<uint32_t>& seqs, Clock::time_point deadline) {
+		for (uint32_t seq : seqs) {
+			auto iter = missing.find(seq);
+			if (iter != missing.end() && iter->second < deadline) {
+				iter->second = deadline;
+				++suppressedCount;
+			}
+		}
+	}
+
+	Clock::time_point nextDeadline() const {
+		Clock::time_point deadline = Clock::time_point::max();
+		for (const auto& [seq, time] : missing) {
+			deadline = std::min(deadline, time);
+		}
+		return deadline;
+	}
+
+	std::string join() const {
+		std::string data;
+		data.reserve((size_t)accepted.totalLength);
+		for (const std::string& segment : segments) {
+			data += segment;
+		}
+		return data;
+	}
+};
+
+namespace {
+	int GetSegmentPacket(uint8_t* buffer, const std::string& data, uint16_t dataLength, uint32_t seq) {
+		size_t offset = (size_t)seq * dataLength;
+		return UdpPacket::write(buffer, UdpPacket::Type::DATA, seq, data.data() + offset,
+			std::min<size_t>(dataLength, data.size() - offset));
+	}
+
+	unsigned long RemainingMilliseconds(Clock::time_point deadline, Clock::time_point now) {
+		if (deadline <= now) {
+			return 1;
+		}
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+		return (unsigned long)std::clamp<long long>(remaining.count(), 1, MULTICAST_RECEIVE_TIMEOUT);
+	}
+}
+
+MulticastProtocol::MulticastProtocol(WSAConnection wsaConnection)
+	: logger([](std::string) {}), wsaConnection(wsaConnection),
+	parameters({ UdpPacket::Protocol::MULTICAST, MULTICAST_BURST, MULTICAST_DATA_LENGTH }) {}
+
+void MulticastProtocol::response(const Socket& socket, const std::vector<Socket::Address>& targets,
+	const std::string& data) {
+	EventLoop loop;
+	loop.run(responseAsync(loop, socket, targets, data));
+}
+
+std::string MulticastProtocol::receive(const std::string& group, unsigned short port, double loss) {
+	EventLoop loop;
+	return loop.run(receiveAsync(loop, group, port, loss));
+}
+
+Task<void> MulticastProtocol::responseAsync(EventLoop& loop, const Socket& socket,
+	std::vector<Socket::Address> targets, const std::string& data) {
+	UdpPacket::Parameters accepted = parameters;
+	accepted.windowSize = std::clamp<uint16_t>(parameters.windowSize, 1, MULTICAST_MAX_BURST);
+	accepted.dataLength = std::clamp<uint16_t>(parameters.dataLength, 1, MULTICAST_DATA_LENGTH);
+	accepted.transferId = UdpPacket::newTransferId();
+	accepted.offset = 0;
+	accepted.totalLength = data.size();
+
+	MulticastStatus status((uint32_t)((data.size() + accepted.dataLength - 1) / accepted.dataLength));
+	PacketBuffer buffer = PacketPool::local().acquire();
+	Socket::Address sender;
+	UdpPacket::Header header;
+	std::vector<uint32_t> seqs, confirmed;
+	int res = 0;
+
+	// 鲥ʱÿݰֻһΣ縴Ƹнշû鲥ʱη͸беÿշ
+	auto sendToGroup = [&](int length) {
+		for (const Socket::Address& target : targets) {
+			socket.send(buffer.get(), length, target);
+		}
+	};
+	auto announce = [&]() {
+		sendToGroup(UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted, status.sent));
+	};
+
+	logger(std::format("[Server] Distributing {} bytes in {} segments to {} targets as transfer {}", data.size(),
+		status.segmentCount, targets.size(), accepted.transferId));
+	announce();
+	Clock::time_point nextHeartbeat = Clock::now() + std::chrono::milliseconds(MULTICAST_HEARTBEAT_INTERVAL);
+
+	while (true) {
+		// ÿһֻһµݰշĻ
+		for (uint16_t i = 0; i < accepted.windowSize && status.sent < status.segmentCount; ++i) {
+			sendToGroup(GetSegmentPacket(buffer.get(), data, accepted.dataLength, status.sent++));
+		}
+
+		// нշ NAKһݰת飬ȱͬݰĽշͲ
+		Clock::time_point now = Clock::now();
+		while ((res = socket.receive(buffer.get(), MULTICAST_BUFFER_LENGTH, sender)) > 0) {
+			if (!UdpPacket::read(buffer.get(), res, header) || header.type != UdpPacket::Type::NAK ||
+				header.seq != accepted.transferId || !UdpPacket::readNak(buffer.get(), header, seqs)) {
+				continue;
+			}
+			++status.nakCount;
+			status.quietCount = 0;
+			if (status.repairs.empty()) {
+				status.repairDeadline = now + std::chrono::milliseconds(MULTICAST_REPAIR_INTERVAL);
+			}
+			confirmed.clear();
+			for (uint32_t seq : seqs) {
+				if (seq < status.sent && status.repairs.insert(seq).second) {
+					confirmed.push_back(seq);
+				}
+			}
+			if (!confirmed.empty()) {
+				sendToGroup(UdpPacket::writeNak(buffer.get(), accepted.transferId, confirmed.data(), confirmed.size()));
+				status.confirmCount += confirmed.size();
+			}
+		}
+
+		// жٽշÿݰֻ޸һ
+		if (!status.repairs.empty() && now >= status.repairDeadline) {
+			for (uint32_t seq : status.repairs) {
+				sendToGroup(GetSegmentPacket(buffer.get(), data, accepted.dataLength, seq));
+			}
+			status.repairCount += status.repairs.size();
+			logger(std::format("[Server] Repaired {} segments", status.repairs.size()));
+			status.repairs.clear();
+		}
+
+		// ߽շѾ˶ݰʧ˽βĽշҲܷȱʧ
+		if (now >= nextHeartbeat) {
+			announce();
+			nextHeartbeat = now + std::chrono::milliseconds(MULTICAST_HEARTBEAT_INTERVAL);
+			if (status.sent == status.segmentCount && status.repairs.empty() &&
+				++status.quietCount >= MULTICAST_LINGER_COUNT) {
+				break;
+			}
+		}
+		co_await loop.sleep(MULTICAST_TICK);
+	}
+
+	logger(std::format("[Server] Distribution {} end: {} segments, {} NAKs, {} segments confirmed, {} repaired",
+		accepted.transferId, status.segmentCount, status.nakCount, status.confirmCount, status.repairCount));
+}
+
+Task<std::string> MulticastProtocol::receiveAsync(EventLoop& loop, std::string group, unsigned short port,
+	double loss) {
+	Socket socket(wsaConnection);
+	socket.init(Socket::ProtocolType::UDP);
+	if (Socket::Address(group, port).isMulticast()) {
+		socket.bind("0.0.0.0", port);
+		socket.joinGroup(group);
+	} else {
+		socket.bind(group, port);
+	}
+	socket.setBlockMode(false);
+
+	std::default_random_engine randomEngine(std::random_device{}());
+	std::uniform_real_distribution<double> lossRandom(0, 1);
+	std::uniform_int_distribution<unsigned long> backoffRandom(0, MULTICAST_NAK_BACKOFF);
+	auto backoff = [&](Clock::time_point now) {
+		return now + std::chrono::milliseconds(backoffRandom(randomEngine));
+	};
+
+	MulticastReceiveStatus status;
+	PacketBuffer buffer = PacketPool::local().acquire();
+	Socket::Address sender;
+	UdpPacket::Header header;
+	UdpPacket::Parameters announced;
+	std::vector<uint32_t> seqs;
+	Clock::time_point lastHeard = Clock::now();
+	int res = 0;
+
+	logger(std::format("[Client] Waiting for distribution on {}:{}", group, port));
+	while (!status.finished()) {
+		Clock::time_point now = Clock::now();
+		unsigned long wait = status.missing.empty() ? MULTICAST_RECEIVE_TIMEOUT :
+			RemainingMilliseconds(status.nextDeadline(), now);
+		res = (co_await loop.receive(socket, buffer.get(), MULTICAST_BUFFER_LENGTH, sender, wait)).length;
+		now = Clock::now();
+
+		if (res > 0 && UdpPacket::read(buffer.get(), res, header)) {
+			lastHeard = now;
+			if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+				if (UdpPacket::readParameters(buffer.get(), header, announced) &&
+					announced.protocol == UdpPacket::Protocol::MULTICAST &&
+					MulticastReceiveStatus::IsAcceptable(announced) &&
+					(!status.announced || announced.transferId == status.accepted.transferId)) {
+					if (!status.announced) {
+						status.announce(announced, sender);
+						logger(std::format("[Client] Joined distribution {} of {} bytes from {}:{}",
+							announced.transferId, announced.totalLength, sender.getIp(), sender.getPort()));
+					}
+					status.discover(header.seq, backoff(now));
+				}
+			} else if (header.type == UdpPacket::Type::DATA && status.announced) {
+				if (lossRandom(randomEngine) < loss) {
+					logger(std::format("[Client] Simulate packet loss, seq = {}", header.seq));
+				} else {
+					status.accept(header.seq, UdpPacket::data(buffer.get()), header.length);
+				}
+				// ݰ˵֮ǰݰѾ͹ˣмĿȱǶʧݰ
+				status.discover(header.seq + 1, backoff(now));
+			} else if (header.type == UdpPacket::Type::NAK && status.announced &&
+				header.seq == status.accepted.transferId && UdpPacket::readNak(buffer.get(), header, seqs)) {
+				status.suppress(seqs, now + std::chrono::milliseconds(MULTICAST_NAK_RETRY));
+			}
+		} else if (now - lastHeard >= std::chrono::milliseconds(MULTICAST_MAX_SILENCE)) {
+			logger("[Client] Distribution timeout, giving up");
+			break;
+		}
+
+		// ڵȱʧݰϲһ NAK ͸ͷ
+		seqs.clear();
+		for (auto& [seq, deadline] : status.missing) {
+			if (deadline <= now && seqs.size() < UdpPacket::MAX_NAK_COUNT) {
+				seqs.push_back(seq);
+				deadline = now + std::chrono::milliseconds(MULTICAST_NAK_RETRY);
+			}
+		}
+		if (!seqs.empty()) {
+			res = UdpPacket::writeNak(buffer.get(), status.accepted.transferId, seqs.data(), seqs.size());
+			socket.send(buffer.get(), res, status.source);
+			++status.nakCount;
+		}
+	}
+
+	if (!status.finished()) {
+		logger(std::format("[Client] Distribution failed with {} of {} segments", status.receivedCount,
+			status.segments.size()));
+		co_return std::string();
+	}
+	logger(std::format("[Client] Distribution {} received: {} NAKs sent, {} requests suppressed",
+		status.accepted.transferId, status.nakCount, status.suppressedCount));
+	co_return status.join();
+}
+
+void MulticastProtocol::setLogger(Logger logger) {
+	this->logger = logger;
+}
+
+void MulticastProtocol::setParameters(const UdpPacket::Parameters& parameters) {
+	this->parameters = parameters;
+	this->parameters.protocol = UdpPacket::Protocol::MULTICAST;
+}
+
+const UdpPacket::Parameters& MulticastProtocol::getParameters() const {
+	return this->parameters;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "UdpReliableProtocol.h"
+#include "EventLoop.h"
+#include <vector>
+
+// Sends one payload to many receivers at once. Every segment goes out once to the targets: a multicast
+// group, where the network makes the copies, or a list of unicast receivers for tests. Receivers only
+// speak up when segments are missing: after a random delay they send a NAK to the sender, which echoes
+// the segments it has not been asked for yet to the whole group, so that receivers missing the same
+// segments hold back their own NAKs. Repairs are collected for a short interval and every segment asked
+// for is sent once, however many receivers asked, so the cost of the sender follows the loss seen by the
+// group rather than the number of receivers. Nothing is acknowledged; the sender stops after a number of
+// heartbeats pass without a NAK.
+class MulticastProtocol final {
+public:
+	MulticastProtocol(WSAConnection wsaConnection);
+
+	typedef UdpReliableProtocol::Logger Logger;
+
+	void response(const Socket& socket, const std::vector<Socket::Address>& targets, const std::string& data);
+	// Binds `port`, joining `group` when it is a multicast address and binding to `group` otherwise, and
+	// waits for one distribution. `loss` is the simulated loss rate of the data. Returns an empty string
+	// when the distribution could not be completed. Announcements of more than 256 MB are ignored, since
+	// anyone can send one to the group.
+	std::string receive(const std::string& group, unsigned short port, double loss);
+
+	// `socket` must be in non-blocking mode; it also receives the NAKs.
+	Task<void> responseAsync(EventLoop& loop, const Socket& socket, std::vector<Socket::Address> targets,
+		const std::string& data);
+	Task<std::string> receiveAsync(EventLoop& loop, std::string group, unsigned short port, double loss);
+
+	void setLogger(Logger logger);
+	void setParameters(const UdpPacket::Parameters& parameters);
+	const UdpPacket::Parameters& getParameters() const;
+
+private:
+	Logger logger;
+	WSAConnection wsaConnection;
+	UdpPacket::Parameters parameters;
+};
@@ -0,0 +1,375 @@
+#include "stdafx.h"
+#include "MuxProtocol.h"
+#include <format>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include "util.h"
+#include "PacketPool.h"
+#include "StreamReassembly.h"
+
+constexpr size_t MUX_BUFFER_LENGTH = UdpPacket::MAX_LENGTH;
+constexpr size_t MUX_DATA_LENGTH = UdpPacket::MAX_DATA_LENGTH;
+constexpr uint16_t MUX_WINDOW_SIZE = 16;
+constexpr uint16_t MUX_MAX_WINDOW_SIZE = 256;
+constexpr size_t MUX_MAX_STREAMS = 64;
+constexpr uint16_t MUX_MAX_WAIT_COUNT = 20;
+constexpr uint32_t MUX_MAX_RETRANSMIT = 10;
+constexpr uint32_t MUX_MAX_HANDSHAKE_ATTEMPT = 5;
+constexpr uint32_t MUX_MAX_IDLE_COUNT = 30;
+constexpr unsigned long MUX_RECEIVE_TIMEOUT = 1000;
+
+enum class MuxStage {
+	CHECK_STATUS,
+	DATA_TRANSMISSION,
+	CLOSED
+};
+
+struct MuxSegment {
+	uint16_t stream;								// 
+	uint64_t offset;								// еλ
+	uint16_t length;								// ݳ
+	bool end;										// ǷΪĽݰ
+	uint16_t waitCount;								// ʱ
+	uint32_t retransmit;							// ش
+	PacketBuffer packet;							// װõݰشʱʹԭֱӷ
+};
+
+struct MuxStatus {
+	std::map<uint32_t, MuxSegment> inFlight;		// Ѿ͵ûȷϵݰȫ
+	std::vector<uint64_t> nextOffset;				// һҪ͵λ
+	std::vector<bool> endSent;						// ǷѾ˽ݰ
+	uint32_t nextSeq;								// һȫ
+	size_t nextStream;								// תȵһ
+	double congestionWindow;						// ӵ
+	uint16_t windowSize;							// Э̺󴰿
+	bool confirmed;									// ǷѾյͻ˵ ACK
+
+	MuxStatus(size_t streamCount, uint16_t windowSize) 
+		: nextOffset(streamCount, 0), endSent(streamCount, false), nextSeq(0), nextStream(0), 
+		congestionWindow(std::min<double>(MUX_WINDOW_SIZE, windowSize)), windowSize(windowSize), confirmed(false) {}
+
+	bool isWindowAvailable() const {
+		return inFlight.size() < (size_t)congestionWindow;
+	}
+
+	// Ӹȡһݰ
+	bool nextSegment(const std::vector<std::string_view>& streams, uint16_t dataLength, MuxSegment& segment) {
+		for (size_t i = 0; i < streams.size(); ++i) {
+			size_t stream = (nextStream + i) % streams.size();
+			if (endSent[stream]) {
+				continue;
+			}
+
+			segment.stream = (uint16_t)stream;
+			segment.offset = nextOffset[stream];
+			segment.waitCount = 0;
+			segment.retransmit = 0;
+			if (nextOffset[stream] < streams[stream].size()) {
+				segment.length = (uint16_t)std::min<size_t>(dataLength, streams[stream].size() - (size_t)nextOffset[stream]);
+				segment.end = false;
+				nextOffset[stream] += segment.length;
+			} else {
+				segment.length = 0;
+				segment.end = true;
+				endSent[stream] = true;
+			}
+			nextStream = (stream + 1) % streams.size();
+			return true;
+		}
+		return false;
+	}
+
+	// յ ACK ʱӵڣʱʱ
+	void onAck() {
+		congestionWindow = std::min<double>(windowSize, congestionWindow + 1.0 / congestionWindow);
+	}
+
+	void onTimeout() {
+		congestionWindow = std::max(1.0, congestionWindow / 2);
+	}
+
+	bool finished() const {
+		return inFlight.empty() && std::all_of(endSent.begin(), endSent.end(), [](bool sent) { return sent; });
+	}
+};
+
+namespace {
+	int GetSegmentPacket(uint8_t* buffer, const std::vector<std::string_view>& streams, uint32_t seq, 
+		const MuxSegment& segment) {
+		if (segment.end) {
+			return UdpPacket::writeStream(buffer, UdpPacket::Type::END, seq, segment.stream, segment.offset);
+		}
+		return UdpPacket::writeStream(buffer, UdpPacket::Type::DATA, seq, segment.stream, segment.offset,
+			streams[segment.stream].data() + segment.offset, segment.length);
+	}
+}
+
+MuxProtocol::MuxProtocol(WSAConnection wsaConnection) 
+	: logger([](std::string) {}), streamCallback([](uint16_t, const std::string&) {}), wsaConnection(wsaConnection),
+	parameters({ UdpPacket::Protocol::MUX, MUX_WINDOW_SIZE, MUX_DATA_LENGTH }) {}
+
+void MuxProtocol::response(const Socket& socket, const Socket::Address& target, 
+	const std::vector<std::string_view>& streams) {
+	EventLoop loop;
+	loop.run(responseAsync(loop, socket, target, streams));
+}
+
+std::vector<std::string> MuxProtocol::receive(const std::string& host, unsigned short port, 
+	const std::vector<std::string>& names, double loss, double ackLoss) {
+	EventLoop loop;
+	return loop.run(receiveAsync(loop, host, port, names, loss, ackLoss));
+}
+
+Task<void> MuxProtocol::responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+	const std::vector<std::string_view>& streams) {
+	UdpPacket::Parameters accepted = parameters;
+	accepted.windowSize = std::clamp<uint16_t>(parameters.windowSize, 1, MUX_MAX_WINDOW_SIZE);
+	accepted.dataLength = std::clamp<uint16_t>(parameters.dataLength, 1, MUX_DATA_LENGTH);
+	accepted.offset = 0;
+	accepted.totalLength = streams.size();
+
+	MuxStage stage = MuxStage::CHECK_STATUS;
+	MuxStatus status(streams.size(), accepted.windowSize);
+	MuxSegment segment;
+	PacketBuffer buffer = PacketPool::local().acquire();
+	UdpPacket::Header header;
+	bool timeout = false;
+	int res = 0;
+
+	while (stage != MuxStage::CLOSED) {
+		switch (stage) {
+		case MuxStage::CHECK_STATUS:
+			// ȷϴֱӷ͵һڵ
+			res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+			socket.send(buffer.get(), res, target);
+			logger(std::format("[Server] Accepted transfer {} with {} streams, window size {}, data length {}",
+				accepted.transferId, streams.size(), accepted.windowSize, accepted.dataLength));
+			stage = MuxStage::DATA_TRANSMISSION;
+			break;
+		case MuxStage::DATA_TRANSMISSION:
+
+			// Ѿ͵ݰʱʹԭ·
+			timeout = false;
+			for (auto& [seq, inFlight] : status.inFlight) {
+				if (++inFlight.waitCount < MUX_MAX_WAIT_COUNT) {
+					continue;
+				}
+				if (++inFlight.retransmit > MUX_MAX_RETRANSMIT) {
+					logger(std::format("[Server] Retransmit failed for {} times, terminating connection", 
+						MUX_MAX_RETRANSMIT));
+					stage = MuxStage::CLOSED;
+					break;
+				}
+				inFlight.waitCount = 0;
+				timeout = true;
+				socket.send(inFlight.packet.get(), inFlight.packet.size(), target);
+				logger(std::format("[Server] Stream {} offset {} timeout, resent as seq {}", 
+					inFlight.stream, inFlight.offset, seq));
+			}
+			if (stage == MuxStage::CLOSED) {
+				break;
+			}
+			if (timeout) {
+				status.onTimeout();
+
+				// ͻ˻ûлӦֻӦѾʧ·
+				if (!status.confirmed) {
+					res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+					socket.send(buffer.get(), res, target);
+				}
+			}
+
+			// ӵķΧ͸ݰ
+			while (status.isWindowAvailable() && status.nextSegment(streams, accepted.dataLength, segment)) {
+				uint32_t seq = status.nextSeq++;
+				segment.packet = PacketPool::local().acquire();
+				segment.packet.setSize(GetSegmentPacket(segment.packet.get(), streams, seq, segment));
+				socket.send(segment.packet.get(), segment.packet.size(), target);
+				logger(std::format("[Server] Sent stream {} offset {} as seq {}{}", segment.stream, segment.offset, seq,
+					segment.end ? " (end)" : ""));
+				status.inFlight.emplace(seq, std::move(segment));
+			}
+
+			//  ACKȷ״̬
+			while ((res = socket.receive(buffer.get(), MUX_BUFFER_LENGTH)) > 0) {
+				if (!UdpPacket::read(buffer.get(), res, header) || header.type != UdpPacket::Type::ACK) {
+					continue;
+				}
+				if (status.inFlight.erase(header.seq) > 0) {
+					status.confirmed = true;
+					status.onAck();
+					logger(std::format("[Server] Received ack {}", header.seq));
+				}
+			}
+
+			if (status.finished()) {
+				logger("[Server] All streams acknowledged, closing connection");
+				stage = MuxStage::CLOSED;
+				break;
+			}
+
+			co_await loop.sleep(500);
+
+			break;
+		}
+	}
+	logger("[Server] Test MUX protocol end");
+}
+
+Task<std::vector<std::string>> MuxProtocol::receiveAsync(EventLoop& loop, std::string host, unsigned short port, 
+	std::vector<std::string> names, double loss, double ackLoss) {
+	std::vector<StreamReassembly> streams(std::min(names.size(), MUX_MAX_STREAMS));
+	std::vector<std::string> result;
+	if (streams.empty()) {
+		co_return result;
+	}
+
+	Socket socket(wsaConnection);
+	socket.init(Socket::ProtocolType::UDP);
+	Socket::Address sender, target(host, port);
+	std::random_device randomDevice;
+	std::default_random_engine engine(randomDevice());
+	std::bernoulli_distribution lossRandom(loss), ackLossRandom(ackLoss);
+
+	PacketBuffer buffer = PacketPool::local().acquire();
+	MuxStage stage = MuxStage::CHECK_STATUS;
+	UdpPacket::Header header;
+	UdpPacket::Parameters request = parameters, accepted;
+	int res = 0;
+	uint32_t handshakeAttempt = 1, idleCount = 0;
+	size_t finishedCount = 0;
+
+	// Я
+	std::string streamNames;
+	for (size_t i = 0; i < streams.size(); ++i) {
+		if (i > 0) {
+			streamNames += '\n';
+		}
+		streamNames += names[i];
+	}
+	request.transferId = UdpPacket::newTransferId();
+	request.offset = 0;
+	request.totalLength = streams.size();
+	// طʹͬţݴʶشΪͬһδ俪ʼỰ
+	auto sendHandshake = [&]() {
+		res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE, request, 0,
+			streamNames.data(), streamNames.size());
+		socket.send(buffer.get(), res, target);
+	};
+
+	socket.setBlockMode(false);
+	sendHandshake();
+
+	while (stage != MuxStage::CLOSED) {
+		res = (co_await loop.receive(socket, buffer.get(), MUX_BUFFER_LENGTH, sender, MUX_RECEIVE_TIMEOUT)).length;
+		if (res <= 0) {
+			if (stage == MuxStage::CHECK_STATUS) {
+				if (handshakeAttempt >= MUX_MAX_HANDSHAKE_ATTEMPT) {
+					logger("[Client] Handshake timeout");
+					stage = MuxStage::CLOSED;
+				} else {
+					++handshakeAttempt;
+					sendHandshake();
+				}
+			} else if (++idleCount >= MUX_MAX_IDLE_COUNT) {
+				logger("[Client] Transfer timeout");
+				stage = MuxStage::CLOSED;
+			}
+			continue;
+		}
+		if (!UdpPacket::read(buffer.get(), res, header)) {
+			continue;
+		}
+		idleCount = 0;
+
+		// ֻӦܶʧʱյݰͬʾѾ˴
+		// Ϊÿδʹõ׽֣֮ Ack ͵ӦԴ
+		if (stage == MuxStage::CHECK_STATUS) {
+			if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+				if (UdpPacket::readParameters(buffer.get(), header, accepted) && 
+					accepted.transferId == request.transferId) {
+					logger(std::format("[Client] Transfer {} accepted, window size {}, data length {}", 
+						accepted.transferId, accepted.windowSize, accepted.dataLength));
+					stage = MuxStage::DATA_TRANSMISSION;
+					target = sender;
+				}
+				continue;
+			}
+			stage = MuxStage::DATA_TRANSMISSION;
+			target = sender;
+		}
+
+		switch (stage) {
+		case MuxStage::DATA_TRANSMISSION:
+			if ((header.type != UdpPacket::Type::DATA && header.type != UdpPacket::Type::END) ||
+				!(header.flags & UdpPacket::FLAG_STREAM) || header.stream >= streams.size()) {
+				break;
+			}
+			if (lossRandom(engine)) {
+				logger(std::format("[Client] Lost seq {}", header.seq));
+				break;
+			}
+
+			// ÿƴӣһĶ
+			if (streams[header.stream].accept(header, UdpPacket::data(buffer.get(), header))) {
+				++finishedCount;
+				logger(std::format("[Client] Stream {} finished, length {}", header.stream, 
+					streams[header.stream].data.size()));
+				streamCallback(header.stream, streams[header.stream].data);
+			}
+
+			// ǷظҪظ ACK
+			if (ackLossRandom(engine)) {
+				logger(std::format("[Client] Lost ack {}", header.seq));
+			} else {
+				res = UdpPacket::write(buffer.get(), UdpPacket::Type::ACK, header.seq);
+				socket.send(buffer.get(), res, target);
+			}
+
+			if (finishedCount == streams.size()) {
+				logger("[Client] All streams finished, closing connection");
+				stage = MuxStage::CLOSED;
+			}
+			break;
+		}
+	}
+
+	for (StreamReassembly& stream : streams) {
+		result.push_back(std::move(stream.data));
+	}
+	co_return result;
+}
+
+void MuxProtocol::setLogger(Logger logger) {
+	this->logger = logger;
+}
+
+void MuxProtocol::setStreamCallback(StreamCallback callback) {
+	this->streamCallback = callback;
+}
+
+void MuxProtocol::setParameters(const UdpPacket::Parameters& parameters) {
+	this->parameters = parameters;
+	this->parameters.protocol = UdpPacket::Protocol::MUX;
+}
+
+const UdpPacket::Parameters& MuxProtocol::getParameters() const {
+	return this->parameters;
+}
+
+std::vector<std::string> MuxProtocol::parseStreamNames(const uint8_t* buffer, const UdpPacket::Header& header) {
+	std::vector<std::string> names;
+	if (header.length <= UdpPacket::PARAMETERS_LENGTH) {
+		return names;
+	}
+
+	std::string list((const char*)UdpPacket::data(buffer) + UdpPacket::PARAMETERS_LENGTH, 
+		header.length - UdpPacket::PARAMETERS_LENGTH);
+	names = util::split(list, "\n");
+	if (names.size() > MUX_MAX_STREAMS) {
+		names.resize(MUX_MAX_STREAMS);
+	}
+	return names;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "UdpReliableProtocol.h"
+#include "EventLoop.h"
+#include <vector>
+#include <string_view>
+
+// Carries several independent byte streams over one session. Segments of all streams share one
+// sequence space, ACK state and congestion window, but each stream is reassembled on its own,
+// so a lost segment only delays the stream it belongs to.
+class MuxProtocol final {
+public:
+	MuxProtocol(WSAConnection wsaConnection);
+
+	typedef UdpReliableProtocol::Logger Logger;
+	typedef std::function<void(uint16_t stream, const std::string& data)> StreamCallback;
+
+	// The streams are only viewed; the data must stay alive until the call finishes.
+	void response(const Socket& socket, const Socket::Address& target, const std::vector<std::string_view>& streams);
+	std::vector<std::string> receive(const std::string& host, unsigned short port, 
+		const std::vector<std::string>& names, double loss, double ackLoss);
+
+	Task<void> responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+		const std::vector<std::string_view>& streams);
+	Task<std::vector<std::string>> receiveAsync(EventLoop& loop, std::string host, unsigned short port, 
+		std::vector<std::string> names, double loss, double ackLoss);
+
+	void setLogger(Logger logger);
+	void setStreamCallback(StreamCallback callback);
+	void setParameters(const UdpPacket::Parameters& parameters);
+	const UdpPacket::Parameters& getParameters() const;
+
+	static std::vector<std::string> parseStreamNames(const uint8_t* buffer, const UdpPacket::Header& header);
+
+private:
+	Logger logger;
+	StreamCallback streamCallback;
+	WSAConnection wsaConnection;
+	UdpPacket::Parameters parameters;
+};
+
@@ -1,18 +1,28 @@
 ﻿#include "stdafx.h"
 #include "UdpReliableServer.h"
 #include "util.h"
+#include "PacketTracer.h"
+#include "ThreadPlacement.h"
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <string_view>
 
 // Test modify 1.0.
 
-int main() {
+// Options: -receivecpus <list> and -workercpus <list> pin the server threads to processors, given as
+// lists such as "0,2,4-7". -peermemory <MB> and -peeridle <seconds> bound the per-peer state of the server.
+int main(int argc, char* argv[]) {
 	WSAConnection wsaConnection;
+	// Declared before the server so that it outlives the transfers writing to it.
+	std::unique_ptr<PacketTracer> tracer;
 	UdpReliableServer server(wsaConnection);
 	std::ofstream logger;
 	logger.open("log.log", std::ios::ate);
 	server.setLogger([&](std::string message) {
-		logger << message << std::endl;
+		char timestamp[32];
+		size_t length = util::format_local_time(timestamp, sizeof(timestamp));
+		logger << std::string_view(timestamp, length) << ' ' << message << std::endl;
 		logger.flush();
 	});
 
@@ -30,6 +40,24 @@ int main() {
 	port = std::stoi(portString);
 	portString.clear();
 
+	std::vector<unsigned> receiveProcessors, workerProcessors;
+	size_t peerMemory = 64;
+	unsigned long peerIdle = 60;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string_view option = argv[i];
+		if (option == "-receivecpus") {
+			receiveProcessors = ThreadPlacement::parse(argv[i + 1]);
+		} else if (option == "-workercpus") {
+			workerProcessors = ThreadPlacement::parse(argv[i + 1]);
+		} else if (option == "-peermemory") {
+			peerMemory = std::stoul(argv[i + 1]);
+		} else if (option == "-peeridle") {
+			peerIdle = std::stoul(argv[i + 1]);
+		}
+	}
+	server.setAffinity(receiveProcessors, workerProcessors);
+	server.setPeerLimits(peerMemory * 1024 * 1024, peerIdle * 1000);
+
 	server.init(ip, port);
 	server.start();
 
@@ -42,15 +70,11 @@ int main() {
 		std::cout << ">>> ";
 		std::string inst;
 		std::getline(std::cin, inst);
-		std::vector<std::string> instList = util::split(inst, " ");
-
-		for (auto iter = instList.begin(); iter != instList.end(); ++iter) {
-			*iter = util::trim(*iter);
-			if (iter->empty()) {
-				iter = instList.erase(iter);
-			}
-			if (iter == instList.end()) {
-				break;
+		std::vector<std::string> instList;
+		for (std::string_view part : util::split_view(inst, " ")) {
+			part = util::trim_view(part);
+			if (!part.empty()) {
+				instList.emplace_back(part);
 			}
 		}
 
@@ -88,6 +112,57 @@ int main() {
 			}
 			std::string result = server.sendTestRequest(targetHost, targetPort, UdpReliableServer::ProtocolType::SR, loss, ackLoss);
 			std::cout << result << std::endl;
+		} else if (inst0 == "-teststripe") {
+			// Each argument is the loss rate of one path; there is one subflow per path.
+			std::vector<double> pathLoss;
+			for (size_t i = 1; i < instList.size(); ++i) {
+				pathLoss.push_back(std::stod(instList[i]));
+			}
+			if (pathLoss.empty()) {
+				pathLoss = { 0.2, 0.2 };
+			}
+			std::string result = server.sendStripeRequest(targetHost, targetPort, "", pathLoss);
+			std::cout << result << std::endl;
+		} else if (inst0 == "-trace") {
+			// Transfers started from now on are traced into the file, for NulTraceAnalyzer.
+			if (tracer != nullptr) {
+				std::cout << "Tracing is already on." << std::endl;
+				continue;
+			}
+			tracer = std::make_unique<PacketTracer>(instList.size() >= 2 ? instList[1] : "trace.bin");
+			server.setTracer(tracer.get());
+			std::cout << "Successfully started tracing." << std::endl;
+		} else if (inst0 == "-testmux") {
+			if (instList.size() < 2) {
+				std::cout << "Invalid instruction, please try again." << std::endl;
+				continue;
+			}
+			std::vector<std::string> names(instList.begin() + 1, instList.end());
+			std::vector<std::string> results = server.sendStreamRequest(targetHost, targetPort, names);
+			for (size_t i = 0; i < results.size(); ++i) {
+				std::cout << "[" << names[i] << "] " << results[i] << std::endl;
+			}
+		} else if (inst0 == "-distribute") {
+			// Sends the test data to a multicast group, or to every listed receiver: <host> <port> ...
+			if (instList.size() < 3 || instList.size() % 2 == 0) {
+				std::cout << "Invalid instruction, please try again." << std::endl;
+				continue;
+			}
+			std::vector<Socket::Address> targets;
+			for (size_t i = 1; i + 1 < instList.size(); i += 2) {
+				targets.emplace_back(instList[i], (unsigned short) std::stoi(instList[i + 1]));
+			}
+			server.distribute("", targets);
+			std::cout << "Distribution finished." << std::endl;
+		} else if (inst0 == "-join") {
+			// Waits for one distribution sent to <group> <port>, with an optional simulated loss rate.
+			if (instList.size() < 3) {
+				std::cout << "Invalid instruction, please try again." << std::endl;
+				continue;
+			}
+			double loss = instList.size() >= 4 ? std::stod(instList[3]) : 0.2;
+			std::string result = server.receiveDistribution(instList[1], (unsigned short) std::stoi(instList[2]), loss);
+			std::cout << result << std::endl;
 		} else {
 			std::string result = server.send(targetHost, targetPort, inst);
 			std::cout << result << std::endl;
@@ -0,0 +1,84 @@
+#include "stdafx.h"
+#include "PacketPool.h"
+
+// Holds the calling thread's pool and lets it go when the thread exits.
+struct PacketPool::Owner {
+	PacketPool* pool = nullptr;
+
+	~Owner() {
+		PacketPool* exiting = pool;
+		pool = nullptr;
+		if (exiting != nullptr) {
+			exiting->unhold();
+		}
+	}
+};
+
+thread_local PacketPool::Owner PacketPool::localOwner;
+
+PacketBuffer::PacketBuffer(const PacketBuffer& other) noexcept : block(other.block) {
+	if (block != nullptr) {
+		block->references.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void PacketBuffer::reset() noexcept {
+	if (block != nullptr && block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		block->pool->release(block);
+	}
+	block = nullptr;
+}
+
+PacketPool::PacketPool() : available(nullptr), returned(nullptr), holds(1) {}
+
+PacketPool& PacketPool::local() {
+	if (localOwner.pool == nullptr) {
+		localOwner.pool = new PacketPool();
+	}
+	return *localOwner.pool;
+}
+
+PacketBuffer PacketPool::acquire() {
+	if (available == nullptr) {
+		available = returned.exchange(nullptr, std::memory_order_acquire);
+	}
+	if (available == nullptr) {
+		slabs.push_back(std::unique_ptr<Block[]>(new Block[SLAB_LENGTH]));
+		Block* slab = slabs.back().get();
+		for (size_t i = 0; i < SLAB_LENGTH; ++i) {
+			slab[i].pool = this;
+			slab[i].next = i + 1 < SLAB_LENGTH ? &slab[i + 1] : nullptr;
+		}
+		available = slab;
+	}
+
+	Block* block = available;
+	available = block->next;
+	block->references.store(1, std::memory_order_relaxed);
+	block->size = 0;
+	holds.fetch_add(1, std::memory_order_relaxed);
+	return PacketBuffer(block);
+}
+
+size_t PacketPool::getCapacity() const {
+	return slabs.size() * SLAB_LENGTH;
+}
+
+void PacketPool::release(Block* block) {
+	if (localOwner.pool == this) {
+		block->next = available;
+		available = block;
+	} else {
+		Block* head = returned.load(std::memory_order_relaxed);
+		do {
+			block->next = head;
+		} while (!returned.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+	}
+	unhold();
+}
+
+void PacketPool::unhold() {
+	if (holds.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		delete this;
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "UdpPacket.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+class PacketPool;
+
+// Reference-counted handle to a packet-sized buffer taken from a PacketPool. Copies share the buffer,
+// which goes back to the pool it came from once the last handle is dropped, on whichever thread that
+// happens. An empty handle holds no buffer.
+class PacketBuffer final {
+public:
+	static constexpr size_t CAPACITY = UdpPacket::MAX_LENGTH;
+
+	PacketBuffer() noexcept : block(nullptr) {}
+	PacketBuffer(const PacketBuffer& other) noexcept;
+	PacketBuffer(PacketBuffer&& other) noexcept : block(other.block) {
+		other.block = nullptr;
+	}
+	PacketBuffer& operator=(PacketBuffer other) noexcept {
+		std::swap(block, other.block);
+		return *this;
+	}
+	~PacketBuffer() {
+		reset();
+	}
+
+	uint8_t* get() const {
+		return block->data;
+	}
+
+	// Length of the packet written into the buffer, kept for whoever sends it again.
+	int size() const {
+		return block->size;
+	}
+
+	void setSize(int size) {
+		block->size = size;
+	}
+
+	explicit operator bool() const {
+		return block != nullptr;
+	}
+
+	void reset() noexcept;
+
+private:
+	struct alignas(64) Block {
+		std::atomic<uint32_t> references;
+		int size;
+		PacketPool* pool;
+		Block* next;
+		uint8_t data[CAPACITY];
+	};
+
+	explicit PacketBuffer(Block* block) noexcept : block(block) {}
+
+	Block* block;
+	friend class PacketPool;
+};
+
+// Free list of packet buffers owned by one thread. Buffers are carved out of slabs of SLAB_LENGTH and are
+// not given back to the system while the thread runs, so a transfer that has warmed up sends and receives
+// without allocating. Buffers released on another thread are queued on a lock-free list that the owner
+// takes back when its own list runs dry. The pool of an exiting thread lives on until its last buffer
+// comes back.
+class PacketPool final {
+public:
+	static constexpr size_t SLAB_LENGTH = 32;
+
+	// The pool of the calling thread, created on first use.
+	static PacketPool& local();
+
+	PacketPool(const PacketPool&) = delete;
+	PacketPool& operator=(const PacketPool&) = delete;
+
+	// The buffer is uninitialized and its size is 0.
+	PacketBuffer acquire();
+
+	// Number of buffers carved so far, in use or not.
+	size_t getCapacity() const;
+
+private:
+	typedef PacketBuffer::Block Block;
+	struct Owner;
+
+	PacketPool();
+	~PacketPool() = default;
+
+	void release(Block* block);
+	void unhold();
+
+	std::vector<std::unique_ptr<Block[]>> slabs;
+	Block* available;							// Touched by the owning thread only.
+	std::atomic<Block*> returned;				// Released by other threads.
+	std::atomic<size_t> holds;					// One per buffer handed out, plus one for the owning thread.
+
+	static thread_local Owner localOwner;
+	friend class PacketBuffer;
+};
@@ -0,0 +1,71 @@
+#include "stdafx.h"
+#include "PacketTracer.h"
+#include "NulNetworkException.h"
+#include "sock.h"
+#include "util.h"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+PacketTracer::PacketTracer(const std::string& path, size_t capacity)
+	: file(INVALID_HANDLE_VALUE), mapping(nullptr), header(nullptr), records(nullptr), capacity(capacity) {
+	if (capacity == 0) {
+		throw NulNetworkException(0, "Trace capacity must not be zero.");
+	}
+	uint64_t size = sizeof(FileHeader) + (uint64_t)capacity * sizeof(Record);
+
+	file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw NulNetworkException(GetLastError(), "Failed to create trace file.");
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, nullptr);
+	if (mapping == nullptr) {
+		DWORD error = GetLastError();
+		CloseHandle(file);
+		throw NulNetworkException(error, "Failed to map trace file.");
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+	if (view == nullptr) {
+		DWORD error = GetLastError();
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw NulNetworkException(error, "Failed to map trace file.");
+	}
+
+	// The mapping starts zeroed, so only the header needs writing. A reader tells unused slots apart by
+	// comparing against `written`.
+	header = (FileHeader*)view;
+	records = (Record*)(header + 1);
+	std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+	header->version = VERSION;
+	header->recordSize = sizeof(Record);
+	header->capacity = capacity;
+	header->written = 0;
+}
+
+PacketTracer::~PacketTracer() {
+	UnmapViewOfFile(header);
+	CloseHandle(mapping);
+	CloseHandle(file);
+}
+
+void PacketTracer::record(Side side, Event event, uint32_t session, uint32_t seq, size_t size, UdpPacket::Type type) {
+	uint64_t index = std::atomic_ref<uint64_t>(header->written).fetch_add(1, std::memory_order_relaxed);
+	Record& record = records[index % capacity];
+	record.timestamp = util::monotonic_ns();
+	record.session = session;
+	record.seq = seq;
+	record.size = (uint16_t)std::min<size_t>(size, UINT16_MAX);
+	record.event = event;
+	record.type = type;
+	record.side = side;
+}
+
+uint64_t PacketTracer::getWritten() const {
+	return std::atomic_ref<uint64_t>(header->written).load(std::memory_order_relaxed);
+}
+
+size_t PacketTracer::getCapacity() const {
+	return capacity;
+}
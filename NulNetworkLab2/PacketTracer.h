@@ -0,0 +1,72 @@
+#pragma once
+#include "UdpPacket.h"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Binary trace of packet events written into a ring of fixed-size records in a memory-mapped file.
+// Recording one event is an atomic increment and a 24-byte store with no formatting or system call, so
+// tracing can stay on in production. The records live in the file mapping, so they survive a crash of
+// the process, and are read offline by NulTraceAnalyzer. Once the ring is full the oldest records are
+// overwritten.
+class PacketTracer final {
+public:
+	enum class Event : uint8_t {
+		SEND = 1,
+		RETRANSMIT,
+		RECEIVE,
+		DROP,			// Discarded by the simulated loss of the receiving side.
+		TIMEOUT			// Retransmission timer of `seq` expired; no packet involved.
+	};
+
+	enum class Side : uint8_t {
+		SERVER = 1,
+		CLIENT
+	};
+
+	struct Record {
+		uint64_t timestamp;		// util::monotonic_ns()
+		uint32_t session;		// transfer ID
+		uint32_t seq;
+		uint16_t size;			// bytes on the wire
+		Event event;
+		UdpPacket::Type type;
+		Side side;
+		uint8_t reserved[3];
+	};
+
+	struct FileHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t capacity;
+		uint64_t written;		// Records ever written; the next one goes to `written % capacity`.
+	};
+
+	static constexpr char MAGIC[8] = { 'N', 'U', 'L', 'T', 'R', 'A', 'C', 'E' };
+	static constexpr uint32_t VERSION = 1;
+	static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+	// Creates or truncates the trace file at `path` with room for `capacity` records.
+	PacketTracer(const std::string& path, size_t capacity = DEFAULT_CAPACITY);
+	~PacketTracer();
+
+	PacketTracer(const PacketTracer&) = delete;
+	PacketTracer& operator=(const PacketTracer&) = delete;
+
+	// Safe to call from any thread.
+	void record(Side side, Event event, uint32_t session, uint32_t seq, size_t size, UdpPacket::Type type);
+
+	uint64_t getWritten() const;
+	size_t getCapacity() const;
+
+private:
+	void* file;
+	void* mapping;
+	FileHeader* header;
+	Record* records;
+	size_t capacity;
+};
+
+static_assert(sizeof(PacketTracer::Record) == 24, "Trace records are read back by their on-disk layout.");
+static_assert(sizeof(PacketTracer::FileHeader) == 32, "The trace file header is read back by its on-disk layout.");
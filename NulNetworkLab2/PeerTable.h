@@ -0,0 +1,269 @@
+#pragma once
+#include "Socket.h"
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+// Per-peer state for very many peers, most of them idle, in bounded memory. Peers are found through an
+// open-addressing index of 32-bit slots with linear probing; the entries themselves sit in a dense array
+// whose positions never change, so the index can be rehashed and shifted freely. Entries idle for longer
+// than the timeout are dropped by a timing wheel: touching a peer only records the time, and an entry is
+// looked at again when its bucket comes round, where it is either dropped or moved to the bucket of its
+// new deadline. Memory is capped: when the table is full, the peer that has been idle the longest is
+// evicted to make room, and new peers are refused while every entry has been active within the current
+// tick of the wheel.
+//
+// Not thread-safe. Pointers to states stay valid until the next call to acquire() or expire().
+template<typename State>
+class PeerTable final {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// Ticks of the wheel in one idle timeout; the wheel has twice as many buckets, so a deadline is never
+	// more than one turn away.
+	static constexpr uint32_t TICKS_PER_TIMEOUT = 64;
+
+	PeerTable(size_t memoryLimit, Clock::duration idleTimeout)
+		: start(Clock::now()), tick(std::max<Clock::duration>(idleTimeout / TICKS_PER_TIMEOUT, std::chrono::milliseconds(1))),
+		maxEntries((uint32_t)std::min<size_t>(memoryLimit / ENTRY_MEMORY, UINT32_MAX - 1)), count(0), currentTick(0),
+		refusedTick(UINT32_MAX), evictedCount(0), refusedCount(0) {
+		wheel.assign(WHEEL_LENGTH, NONE);
+	}
+
+	PeerTable(const PeerTable&) = delete;
+	PeerTable& operator=(const PeerTable&) = delete;
+
+	// The state of the peer with `key`, marked active at `now`; null when the peer is unknown. Callers
+	// choose what identifies a peer, for example by clearing the port of the key to keep state per host.
+	State* find(const Socket::Address::Key& key, Clock::time_point now) {
+		uint32_t slot = lookup(key, Hash(key));
+		if (index.empty() || index[slot] == NONE) {
+			return nullptr;
+		}
+		Entry& entry = entries[index[slot]];
+		entry.lastActive = tickOf(now);
+		return &entry.state;
+	}
+
+	// Like find(), but adds a peer that is not known yet with a default state. Null when the table is full
+	// and no entry has been idle for a whole tick.
+	State* acquire(const Socket::Address::Key& key, Clock::time_point now) {
+		uint32_t hash = Hash(key);
+		uint32_t nowTick = tickOf(now);
+		uint32_t slot = lookup(key, hash);
+		if (!index.empty() && index[slot] != NONE) {
+			Entry& entry = entries[index[slot]];
+			entry.lastActive = nowTick;
+			return &entry.state;
+		}
+
+		expire(now);
+		if (size() >= maxEntries && !evictIdlest(nowTick)) {
+			++refusedCount;
+			return nullptr;
+		}
+
+		uint32_t position;
+		if (!freeEntries.empty()) {
+			position = freeEntries.back();
+			freeEntries.pop_back();
+		} else {
+			if (entries.size() == entries.capacity()) {
+				entries.reserve(std::min<size_t>(std::max<size_t>(entries.capacity() * 2, MIN_ENTRIES), maxEntries));
+			}
+			position = (uint32_t)entries.size();
+			entries.emplace_back();
+		}
+		if ((size() + 1) * 2 > index.size()) {
+			rehash(std::max<size_t>(index.size() * 2, MIN_ENTRIES * 2));
+		}
+
+		Entry& entry = entries[position];
+		entry.key = key;
+		entry.hash = hash;
+		entry.lastActive = nowTick;
+		entry.state = State();
+		index[lookup(key, hash)] = position;
+		++count;
+		schedule(position, nowTick + TICKS_PER_TIMEOUT);
+		return &entry.state;
+	}
+
+	// Drops the entries whose idle timeout has passed. Cheap to call on every packet: it only does work
+	// when a tick of the wheel has passed.
+	void expire(Clock::time_point now) {
+		uint32_t nowTick = tickOf(now);
+		for (; currentTick < nowTick; ++currentTick) {
+			uint32_t position = wheel[currentTick % WHEEL_LENGTH];
+			wheel[currentTick % WHEEL_LENGTH] = NONE;
+			while (position != NONE) {
+				uint32_t next = entries[position].nextInWheel;
+				visit(position, currentTick);
+				position = next;
+			}
+		}
+	}
+
+	size_t size() const {
+		return count;
+	}
+
+	// Largest number of peers the memory limit allows.
+	size_t getCapacity() const {
+		return maxEntries;
+	}
+
+	// Bytes held by the table; within the memory limit apart from the few hundred bytes of the wheel.
+	size_t getMemoryUsage() const {
+		return entries.capacity() * sizeof(Entry) + index.capacity() * sizeof(uint32_t) +
+			freeEntries.capacity() * sizeof(uint32_t) + wheel.capacity() * sizeof(uint32_t);
+	}
+
+	// Peers dropped while still fresh to make room, and peers turned away because nothing could be.
+	uint64_t getEvictedCount() const {
+		return evictedCount;
+	}
+
+	uint64_t getRefusedCount() const {
+		return refusedCount;
+	}
+
+private:
+	struct Entry {
+		Socket::Address::Key key;
+		uint32_t hash;
+		uint32_t lastActive;						// Tick of the last packet.
+		uint32_t nextInWheel;						// Next entry in the same bucket.
+		State state;
+	};
+
+	static constexpr uint32_t NONE = UINT32_MAX;
+	static constexpr uint32_t WHEEL_LENGTH = TICKS_PER_TIMEOUT * 2;
+	static constexpr size_t MIN_ENTRIES = 64;
+	// Worst case per entry: the entry, up to four index slots as the index stays at most half full and
+	// rounds up to a power of two, and a place in the free list.
+	static constexpr size_t ENTRY_MEMORY = sizeof(Entry) + 5 * sizeof(uint32_t);
+
+	static uint32_t Hash(const Socket::Address::Key& key) {
+		uint64_t high, low;
+		std::memcpy(&high, key.ip, sizeof(high));
+		std::memcpy(&low, key.ip + sizeof(high), sizeof(low));
+		uint64_t value = high ^ (low * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)key.port << 8 | key.family);
+		value ^= value >> 33;
+		value *= 0xff51afd7ed558ccdull;
+		value ^= value >> 33;
+		return (uint32_t)value;
+	}
+
+	uint32_t tickOf(Clock::time_point now) const {
+		return (uint32_t)((now - start) / tick);
+	}
+
+	// Slot holding `key`, or the empty slot where it would go.
+	uint32_t lookup(const Socket::Address::Key& key, uint32_t hash) const {
+		if (index.empty()) {
+			return 0;
+		}
+		uint32_t mask = (uint32_t)index.size() - 1;
+		uint32_t slot = hash & mask;
+		while (index[slot] != NONE) {
+			const Entry& entry = entries[index[slot]];
+			if (entry.hash == hash && entry.key == key) {
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return slot;
+	}
+
+	void rehash(size_t length) {
+		std::vector<uint32_t> old = std::move(index);
+		index.assign(length, NONE);
+		for (uint32_t position : old) {
+			if (position != NONE) {
+				index[lookup(entries[position].key, entries[position].hash)] = position;
+			}
+		}
+	}
+
+	// Backward-shift deletion keeps every probe sequence unbroken without tombstones.
+	void remove(uint32_t position) {
+		uint32_t mask = (uint32_t)index.size() - 1;
+		uint32_t slot = lookup(entries[position].key, entries[position].hash);
+		uint32_t next = (slot + 1) & mask;
+		while (index[next] != NONE) {
+			uint32_t home = entries[index[next]].hash & mask;
+			if (((next - home) & mask) >= ((next - slot) & mask)) {
+				index[slot] = index[next];
+				slot = next;
+			}
+			next = (next + 1) & mask;
+		}
+		index[slot] = NONE;
+		freeEntries.push_back(position);
+		--count;
+	}
+
+	void schedule(uint32_t position, uint32_t deadline) {
+		uint32_t& head = wheel[deadline % WHEEL_LENGTH];
+		entries[position].nextInWheel = head;
+		head = position;
+	}
+
+	// An entry whose bucket came round is dropped if it stayed idle, and rescheduled otherwise.
+	void visit(uint32_t position, uint32_t atTick) {
+		uint32_t deadline = entries[position].lastActive + TICKS_PER_TIMEOUT;
+		if (deadline <= atTick) {
+			remove(position);
+		} else {
+			schedule(position, deadline);
+		}
+	}
+
+	// Walks the buckets in deadline order and evicts the first entry that has been idle for at least a
+	// tick; entries met on the way that turn out to be active are rescheduled. Once a walk finds nothing,
+	// new peers are refused without walking again until the next tick.
+	bool evictIdlest(uint32_t nowTick) {
+		if (refusedTick == nowTick) {
+			return false;
+		}
+		for (uint32_t offset = 0; offset < WHEEL_LENGTH; ++offset) {
+			uint32_t bucket = (currentTick + offset) % WHEEL_LENGTH;
+			uint32_t position = wheel[bucket];
+			wheel[bucket] = NONE;
+			bool evicted = false;
+			while (position != NONE) {
+				uint32_t next = entries[position].nextInWheel;
+				if (!evicted && entries[position].lastActive < nowTick) {
+					remove(position);
+					++evictedCount;
+					evicted = true;
+				} else {
+					schedule(position, std::max(entries[position].lastActive + TICKS_PER_TIMEOUT, currentTick + offset));
+				}
+				position = next;
+			}
+			if (evicted) {
+				return true;
+			}
+		}
+		refusedTick = nowTick;
+		return false;
+	}
+
+	Clock::time_point start;
+	Clock::duration tick;
+	uint32_t maxEntries;
+	std::vector<Entry> entries;
+	std::vector<uint32_t> index;					// Slot to entry position, NONE when empty.
+	std::vector<uint32_t> freeEntries;
+	std::vector<uint32_t> wheel;					// Bucket to the first entry due in it.
+	size_t count;
+	uint32_t currentTick;							// First tick whose bucket has not been visited.
+	uint32_t refusedTick;
+	uint64_t evictedCount;
+	uint64_t refusedCount;
+};
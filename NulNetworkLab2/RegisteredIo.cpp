@@ -0,0 +1,351 @@
+#include "stdafx.h"
+#include "RegisteredIo.h"
+#include "UdpPacket.h"
+#include <mutex>
+#include <algorithm>
+
+// Layout of the region of each socket: receive slots, send slots, then one address per slot. Every
+// datagram this program sends is a UdpPacket, so a slot only needs to hold the largest one.
+constexpr ULONG RIO_RECEIVE_SLOTS = 32;
+constexpr ULONG RIO_SEND_SLOTS = 16;
+constexpr ULONG RIO_SLOT_LENGTH = (ULONG)(UdpPacket::MAX_LENGTH + 63) / 64 * 64;
+constexpr ULONG RIO_ADDRESS_LENGTH = sizeof(SOCKADDR_INET);
+constexpr ULONG RIO_TOTAL_SLOTS = RIO_RECEIVE_SLOTS + RIO_SEND_SLOTS;
+constexpr ULONG RIO_REGION_LENGTH = (RIO_TOTAL_SLOTS * (RIO_SLOT_LENGTH + RIO_ADDRESS_LENGTH) + 63) / 64 * 64;
+// Regions are carved out of chunks that are registered once and kept for the life of the process, so
+// a socket costs neither a registration of its own nor a whole allocation granule.
+constexpr ULONG RIO_REGIONS_PER_CHUNK = 32;
+constexpr ULONG RIO_CHUNK_LENGTH = RIO_REGIONS_PER_CHUNK * RIO_REGION_LENGTH;
+
+namespace {
+	RIO_EXTENSION_FUNCTION_TABLE rio;
+	bool rioSupported = false;
+	std::once_flag rioLoaded;
+
+	void LoadFunctionTable(SOCKET socket) {
+		GUID functionTableId = WSAID_MULTIPLE_RIO;
+		DWORD bytes = 0;
+		std::memset(&rio, 0, sizeof(rio));
+		rio.cbSize = sizeof(rio);
+		rioSupported = WSAIoctl(socket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &functionTableId, 
+			sizeof(functionTableId), &rio, sizeof(rio), &bytes, nullptr, nullptr) == 0;
+	}
+
+	inline ULONG DataOffset(ULONG slot) {
+		return slot * RIO_SLOT_LENGTH;
+	}
+
+	inline ULONG AddressOffset(ULONG slot) {
+		return RIO_TOTAL_SLOTS * RIO_SLOT_LENGTH + slot * RIO_ADDRESS_LENGTH;
+	}
+
+	struct Region {
+		RIO_BUFFERID bufferId;
+		ULONG offset;
+		char* data;
+	};
+
+	class RegionPool final {
+	public:
+		bool acquire(Region& region) {
+			std::lock_guard<std::mutex> locked(mutex);
+			if (freeRegions.empty() && !grow()) {
+				return false;
+			}
+			region = freeRegions.back();
+			freeRegions.pop_back();
+			return true;
+		}
+
+		void release(const Region& region) {
+			std::lock_guard<std::mutex> locked(mutex);
+			freeRegions.push_back(region);
+		}
+
+	private:
+		bool grow() {
+			char* chunk = (char*)VirtualAlloc(nullptr, RIO_CHUNK_LENGTH, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (chunk == nullptr) {
+				return false;
+			}
+			RIO_BUFFERID bufferId = rio.RIORegisterBuffer(chunk, RIO_CHUNK_LENGTH);
+			if (bufferId == RIO_INVALID_BUFFERID) {
+				VirtualFree(chunk, 0, MEM_RELEASE);
+				return false;
+			}
+			for (ULONG i = 0; i < RIO_REGIONS_PER_CHUNK; ++i) {
+				freeRegions.push_back({ bufferId, i * RIO_REGION_LENGTH, chunk + i * RIO_REGION_LENGTH });
+			}
+			return true;
+		}
+
+		std::mutex mutex;
+		std::vector<Region> freeRegions;
+	};
+
+	RegionPool regions;
+}
+
+RegisteredIo::RegisteredIo(SOCKET socket) 
+	: socket(socket), requestQueue(RIO_INVALID_RQ), receiveQueue(RIO_INVALID_CQ), sendQueue(RIO_INVALID_CQ),
+	receiveEvent(nullptr), bufferId(RIO_INVALID_BUFFERID), bufferOffset(0), buffer(nullptr), receivesPosted(false), 
+	commitPending(false), blocked(true), receiveTimeout(0) {}
+
+RegisteredIo::~RegisteredIo() {
+	// The request queue is released together with the socket, which the owner closes first.
+	if (receiveQueue != RIO_INVALID_CQ) {
+		rio.RIOCloseCompletionQueue(receiveQueue);
+	}
+	if (sendQueue != RIO_INVALID_CQ) {
+		rio.RIOCloseCompletionQueue(sendQueue);
+	}
+	if (buffer != nullptr) {
+		regions.release({ bufferId, bufferOffset, buffer });
+	}
+	if (receiveEvent != nullptr) {
+		CloseHandle(receiveEvent);
+	}
+}
+
+SOCKET RegisteredIo::createSocket(int family) {
+	SOCKET socket = WSASocketW(family, SOCK_DGRAM, IPPROTO_UDP, nullptr, 0, WSA_FLAG_REGISTERED_IO);
+	if (socket == INVALID_SOCKET) {
+		return INVALID_SOCKET;
+	}
+	std::call_once(rioLoaded, LoadFunctionTable, socket);
+	if (!rioSupported) {
+		closesocket(socket);
+		return INVALID_SOCKET;
+	}
+	return socket;
+}
+
+RegisteredIo* RegisteredIo::create(SOCKET socket) {
+	RegisteredIo* registeredIo = new RegisteredIo(socket);
+	if (!registeredIo->init()) {
+		delete registeredIo;
+		return nullptr;
+	}
+	return registeredIo;
+}
+
+bool RegisteredIo::init() {
+	Region region;
+	if (!regions.acquire(region)) {
+		return false;
+	}
+	bufferId = region.bufferId;
+	bufferOffset = region.offset;
+	buffer = region.data;
+
+	// Receive completions can also raise an event, which blocking receives and event loops wait on.
+	receiveEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+	if (receiveEvent == nullptr) {
+		return false;
+	}
+	RIO_NOTIFICATION_COMPLETION notification;
+	std::memset(&notification, 0, sizeof(notification));
+	notification.Type = RIO_EVENT_COMPLETION;
+	notification.Event.EventHandle = receiveEvent;
+	notification.Event.NotifyReset = TRUE;
+
+	receiveQueue = rio.RIOCreateCompletionQueue(RIO_RECEIVE_SLOTS, &notification);
+	sendQueue = rio.RIOCreateCompletionQueue(RIO_SEND_SLOTS, nullptr);
+	if (receiveQueue == RIO_INVALID_CQ || sendQueue == RIO_INVALID_CQ) {
+		return false;
+	}
+	requestQueue = rio.RIOCreateRequestQueue(socket, RIO_RECEIVE_SLOTS, 1, RIO_SEND_SLOTS, 1, receiveQueue, 
+		sendQueue, nullptr);
+	if (requestQueue == RIO_INVALID_RQ) {
+		return false;
+	}
+
+	for (ULONG i = 0; i < RIO_SEND_SLOTS; ++i) {
+		freeSendSlots.push_back(RIO_RECEIVE_SLOTS + i);
+	}
+	return true;
+}
+
+bool RegisteredIo::postReceive(ULONG slot, DWORD flags) {
+	RIO_BUF data = { bufferId, bufferOffset + DataOffset(slot), RIO_SLOT_LENGTH };
+	RIO_BUF address = { bufferId, bufferOffset + AddressOffset(slot), RIO_ADDRESS_LENGTH };
+	return rio.RIOReceiveEx(requestQueue, &data, 1, nullptr, &address, nullptr, nullptr, flags, 
+		(PVOID)(ULONG_PTR)slot) != FALSE;
+}
+
+// Receives can only be posted once the socket has a local address, so they are posted on first use.
+bool RegisteredIo::postReceives() {
+	if (receivesPosted) {
+		return true;
+	}
+	if (!postReceive(0, 0)) {
+		return false;
+	}
+	for (ULONG i = 1; i < RIO_RECEIVE_SLOTS; ++i) {
+		postReceive(i, RIO_MSG_DEFER);
+	}
+	commitPending = true;
+	commitReceives();
+	receivesPosted = true;
+	return true;
+}
+
+void RegisteredIo::commitReceives() {
+	if (commitPending) {
+		rio.RIOReceiveEx(requestQueue, nullptr, 0, nullptr, nullptr, nullptr, nullptr, RIO_MSG_COMMIT_ONLY, nullptr);
+		commitPending = false;
+	}
+}
+
+bool RegisteredIo::dequeueReceives() {
+	if (receivedResults.empty()) {
+		RIORESULT results[RIO_RECEIVE_SLOTS];
+		ULONG count = rio.RIODequeueCompletion(receiveQueue, results, RIO_RECEIVE_SLOTS);
+		if (count != RIO_CORRUPT_CQ) {
+			receivedResults.insert(receivedResults.end(), results, results + count);
+		}
+	}
+	return !receivedResults.empty();
+}
+
+// A timeout of zero waits forever, matching SO_RCVTIMEO.
+bool RegisteredIo::waitReceives(unsigned long timeout) {
+	ULONGLONG deadline = GetTickCount64() + timeout;
+	while (!dequeueReceives()) {
+		// Arm the notification and check once more, since a completion may have slipped in meanwhile.
+		int res = rio.RIONotify(receiveQueue);
+		if (res != ERROR_SUCCESS && res != WSAEALREADY) {
+			WSASetLastError(res);
+			return false;
+		}
+		if (dequeueReceives()) {
+			break;
+		}
+
+		DWORD wait = INFINITE;
+		if (timeout > 0) {
+			ULONGLONG now = GetTickCount64();
+			wait = now >= deadline ? 0 : (DWORD)(deadline - now);
+		}
+		if (WaitForSingleObject(receiveEvent, wait) != WAIT_OBJECT_0) {
+			if (dequeueReceives()) {
+				break;
+			}
+			WSASetLastError(WSAETIMEDOUT);
+			return false;
+		}
+	}
+	return true;
+}
+
+int RegisteredIo::receive(void* data, int length, sockaddr* sender, int senderLength) {
+	if (!postReceives()) {
+		return SOCKET_ERROR;
+	}
+	if (!dequeueReceives()) {
+		if (!blocked) {
+			WSASetLastError(WSAEWOULDBLOCK);
+			return SOCKET_ERROR;
+		}
+		if (!waitReceives(receiveTimeout)) {
+			return SOCKET_ERROR;
+		}
+	}
+
+	RIORESULT result = receivedResults.front();
+	receivedResults.pop_front();
+	ULONG slot = (ULONG)result.RequestContext;
+	int res = SOCKET_ERROR;
+	if (result.Status != 0) {
+		WSASetLastError(result.Status);
+	} else if ((int)result.BytesTransferred > length) {
+		std::memcpy(data, buffer + DataOffset(slot), length);
+		WSASetLastError(WSAEMSGSIZE);
+	} else {
+		std::memcpy(data, buffer + DataOffset(slot), result.BytesTransferred);
+		res = (int)result.BytesTransferred;
+	}
+	if (sender != nullptr) {
+		const SOCKADDR_INET* address = (const SOCKADDR_INET*)(buffer + AddressOffset(slot));
+		int addressLength = address->si_family == AF_INET6 ? (int)sizeof(sockaddr_in6) : (int)sizeof(sockaddr_in);
+		std::memcpy(sender, address, std::min(senderLength, addressLength));
+	}
+
+	// Hand the slot back to the kernel, committing once the batch is used up.
+	postReceive(slot, RIO_MSG_DEFER);
+	commitPending = true;
+	if (receivedResults.empty()) {
+		commitReceives();
+	}
+	return res;
+}
+
+int RegisteredIo::send(const void* data, int length, const sockaddr* target, int targetLength) {
+	if (freeSendSlots.empty()) {
+		reclaimSends();
+	}
+
+	// Oversized datagrams and bursts beyond the registered slots go through the plain path.
+	if (length > (int)RIO_SLOT_LENGTH || targetLength > (int)RIO_ADDRESS_LENGTH || freeSendSlots.empty()) {
+		return ::sendto(socket, (const char*)data, length, 0, target, targetLength);
+	}
+
+	ULONG slot = freeSendSlots.back();
+	freeSendSlots.pop_back();
+	std::memcpy(buffer + DataOffset(slot), data, length);
+	std::memset(buffer + AddressOffset(slot), 0, RIO_ADDRESS_LENGTH);
+	std::memcpy(buffer + AddressOffset(slot), target, targetLength);
+
+	RIO_BUF dataBuffer = { bufferId, bufferOffset + DataOffset(slot), (ULONG)length };
+	RIO_BUF addressBuffer = { bufferId, bufferOffset + AddressOffset(slot), RIO_ADDRESS_LENGTH };
+	if (!rio.RIOSendEx(requestQueue, &dataBuffer, 1, nullptr, &addressBuffer, nullptr, nullptr, 0, 
+		(PVOID)(ULONG_PTR)slot)) {
+		freeSendSlots.push_back(slot);
+		return SOCKET_ERROR;
+	}
+	return length;
+}
+
+HANDLE RegisteredIo::notify() {
+	if (!postReceives() || dequeueReceives()) {
+		return nullptr;
+	}
+	// As in waitReceives, a completion may slip in between the check and arming the notification.
+	int res = rio.RIONotify(receiveQueue);
+	if ((res != ERROR_SUCCESS && res != WSAEALREADY) || dequeueReceives()) {
+		return nullptr;
+	}
+	return receiveEvent;
+}
+
+bool RegisteredIo::poll(BusyPoll& busyPoll, unsigned long timeout) {
+	if (!postReceives()) {
+		return false;
+	}
+	BusyPoll::Clock::time_point deadline = BusyPoll::Clock::now() + std::chrono::milliseconds(timeout);
+	if (dequeueReceives() || busyPoll.spin([this]() { return dequeueReceives(); }, deadline)) {
+		return true;
+	}
+	unsigned long remaining = (unsigned long)std::chrono::ceil<std::chrono::milliseconds>(
+		std::max(deadline - BusyPoll::Clock::now(), BusyPoll::Clock::duration::zero())).count();
+	return remaining > 0 ? waitReceives(remaining) : dequeueReceives();
+}
+
+void RegisteredIo::reclaimSends() {
+	RIORESULT results[RIO_SEND_SLOTS];
+	ULONG count = rio.RIODequeueCompletion(sendQueue, results, RIO_SEND_SLOTS);
+	if (count == RIO_CORRUPT_CQ) {
+		return;
+	}
+	for (ULONG i = 0; i < count; ++i) {
+		freeSendSlots.push_back((ULONG)results[i].RequestContext);
+	}
+}
+
+void RegisteredIo::setBlockMode(bool blocked) {
+	this->blocked = blocked;
+}
+
+void RegisteredIo::setReceiveTimeout(unsigned long milliseconds) {
+	this->receiveTimeout = milliseconds;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "sock.h"
+#include "BusyPoll.h"
+#include <MSWSock.h>
+#include <deque>
+#include <vector>
+
+// Datagram I/O through Winsock Registered I/O. Packet buffers are registered with the kernel once, in
+// chunks shared by all sockets, receives are kept posted ahead of time and completions are collected in
+// batches from a polled completion queue, so in the steady state sending or receiving a packet costs no
+// system call.
+// Socket uses it for UDP whenever the system supports it. Like the RIO request queue itself, an
+// instance must not be used from several threads at once.
+class RegisteredIo final {
+public:
+	RegisteredIo(const RegisteredIo&) = delete;
+	RegisteredIo& operator=(const RegisteredIo&) = delete;
+	~RegisteredIo();
+
+	// Returns INVALID_SOCKET when registered I/O is not available on this system.
+	static SOCKET createSocket(int family);
+	// Returns nullptr when the queues or buffers for `socket` could not be set up.
+	static RegisteredIo* create(SOCKET socket);
+
+	int receive(void* data, int length, sockaddr* sender, int senderLength);
+	int send(const void* data, int length, const sockaddr* target, int targetLength);
+	// Waits until a receive has completed; spinning on the completion queue costs no system call.
+	bool poll(BusyPoll& busyPoll, unsigned long timeout);
+	// Arms the completion notification for a caller that waits on several sockets at once. Returns the
+	// event that will be raised, or nullptr when a receive is already waiting or arming failed, in which
+	// case the next receive returns at once.
+	HANDLE notify();
+
+	void setBlockMode(bool blocked);
+	void setReceiveTimeout(unsigned long milliseconds);
+
+private:
+	RegisteredIo(SOCKET socket);
+	bool init();
+	bool postReceives();
+	bool postReceive(ULONG slot, DWORD flags);
+	void commitReceives();
+	bool dequeueReceives();
+	bool waitReceives(unsigned long timeout);
+	void reclaimSends();
+
+	SOCKET socket;
+	RIO_RQ requestQueue;
+	RIO_CQ receiveQueue, sendQueue;
+	HANDLE receiveEvent;
+	RIO_BUFFERID bufferId;
+	ULONG bufferOffset;
+	char* buffer;
+	std::deque<RIORESULT> receivedResults;
+	std::vector<ULONG> freeSendSlots;
+	bool receivesPosted, commitPending, blocked;
+	unsigned long receiveTimeout;
+};
+
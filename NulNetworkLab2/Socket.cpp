@@ -2,24 +2,117 @@
 #include "sock.h"
 #include "Socket.h"
 #include "NulNetworkException.h"
+#include "RegisteredIo.h"
 #include <format>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cstring>
 
 typedef Socket::IPType IPType;
 
+// getaddrinfo does not report DNS record TTLs, so resolved names are simply kept for a fixed time.
+constexpr auto RESOLVE_CACHE_TTL = std::chrono::seconds(60);
+constexpr size_t RESOLVE_CACHE_CAPACITY = 256;
+
 namespace {
 	inline SOCKET& GetSocket(void* socket) {
 		return *((SOCKET*)socket);
 	}
+
+	bool WaitReadable(SOCKET socket, BusyPoll& busyPoll, unsigned long timeout) {
+		BusyPoll::Clock::time_point deadline = BusyPoll::Clock::now() + std::chrono::milliseconds(timeout);
+		WSAPOLLFD fd;
+		fd.fd = socket;
+		fd.events = POLLRDNORM;
+		fd.revents = 0;
+		if (busyPoll.spin([&fd]() { return WSAPoll(&fd, 1, 0) > 0; }, deadline)) {
+			return true;
+		}
+
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+			std::max(deadline - BusyPoll::Clock::now(), BusyPoll::Clock::duration::zero()));
+		fd.revents = 0;
+		return WSAPoll(&fd, 1, (int)remaining.count()) > 0;
+	}
+
+	inline int AddressLength(const sockaddr_storage& address) {
+		return address.ss_family == AF_INET6 ? (int)sizeof(sockaddr_in6) : (int)sizeof(sockaddr_in);
+	}
+
+	struct ResolvedHost {
+		sockaddr_storage address;
+		std::chrono::steady_clock::time_point expires;
+	};
+
+	std::mutex resolveCacheMutex;
+	std::unordered_map<std::string, ResolvedHost> resolveCache;
+
+	// Fills in `address` with port 0 and returns its length. IPv4 results are preferred since sockets
+	// default to IPv4.
+	int ResolveHost(const std::string& host, sockaddr_storage& address) {
+		std::memset(&address, 0, sizeof(address));
+
+		// Numeric addresses need no lookup at all.
+		if (inet_pton(AF_INET, host.c_str(), &((sockaddr_in*)&address)->sin_addr) == 1) {
+			address.ss_family = AF_INET;
+			return (int)sizeof(sockaddr_in);
+		}
+		if (inet_pton(AF_INET6, host.c_str(), &((sockaddr_in6*)&address)->sin6_addr) == 1) {
+			address.ss_family = AF_INET6;
+			return (int)sizeof(sockaddr_in6);
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		{
+			std::lock_guard<std::mutex> locked(resolveCacheMutex);
+			auto cached = resolveCache.find(host);
+			if (cached != resolveCache.end() && cached->second.expires > now) {
+				address = cached->second.address;
+				return AddressLength(address);
+			}
+		}
+
+		addrinfo hints, *resultRaw;
+		std::memset(&hints, 0, sizeof(hints));
+		int res = getaddrinfo(host.c_str(), nullptr, &hints, &resultRaw);
+		if (res != 0) {
+			throw NulNetworkException(GetLastError(), std::format("Failed to resolve host {}", host));
+		}
+
+		const addrinfo* chosen = resultRaw;
+		for (const addrinfo* resultPtr = resultRaw; resultPtr != nullptr; resultPtr = resultPtr->ai_next) {
+			if (resultPtr->ai_family == AF_INET) {
+				chosen = resultPtr;
+				break;
+			}
+		}
+		std::memcpy(&address, chosen->ai_addr, std::min(sizeof(address), (size_t)chosen->ai_addrlen));
+		freeaddrinfo(resultRaw);
+
+		std::lock_guard<std::mutex> locked(resolveCacheMutex);
+		if (resolveCache.size() >= RESOLVE_CACHE_CAPACITY) {
+			std::erase_if(resolveCache, [now](const auto& entry) { return entry.second.expires <= now; });
+			if (resolveCache.size() >= RESOLVE_CACHE_CAPACITY) {
+				resolveCache.clear();
+			}
+		}
+		resolveCache[host] = { address, now + RESOLVE_CACHE_TTL };
+		return AddressLength(address);
+	}
 }
 
 Socket::Socket(Socket&& other) noexcept {
 	this->socket = other.socket;
+	this->registeredIo = other.registeredIo;
+	this->busyPoll = other.busyPoll;
 	this->ipType = std::move(other.ipType);
 	this->wsaConnection = std::move(other.wsaConnection);
 	other.socket = nullptr;
+	other.registeredIo = nullptr;
 }
 
-Socket::Socket(WSAConnection wsaConnection) : socket(new SOCKET(INVALID_SOCKET)),
+Socket::Socket(WSAConnection wsaConnection) : socket(new SOCKET(INVALID_SOCKET)), registeredIo(nullptr),
 ipType(IPType::IPv4), wsaConnection(wsaConnection) {}
 
 Socket::~Socket() {
@@ -51,7 +144,21 @@ void Socket::init(ProtocolType protocolType, IPType ipType) {
 	}
 
 	SOCKET& socket = GetSocket(this->socket);
-	socket = ::socket(inetType, type, protocol);
+
+	// UDP sockets use registered I/O when available, and plain Winsock calls otherwise.
+	if (protocolType == ProtocolType::UDP) {
+		socket = RegisteredIo::createSocket(inetType);
+		if (socket != INVALID_SOCKET) {
+			registeredIo = RegisteredIo::create(socket);
+			if (registeredIo == nullptr) {
+				closesocket(socket);
+				socket = INVALID_SOCKET;
+			}
+		}
+	}
+	if (socket == INVALID_SOCKET) {
+		socket = ::socket(inetType, type, protocol);
+	}
 
 	if (socket == INVALID_SOCKET) {
 		throw NulNetworkException(WSAGetLastError(), "Failed to initialize socket.");
@@ -140,16 +247,15 @@ void Socket::listen() {
 
 Socket Socket::accept() {
 	SOCKET& serverSocket = GetSocket(this->socket);
-	sockaddr_in acceptAddr;
-	int addrLen = sizeof(SOCKADDR_IN);
+	Address address;
+	int addrLen = (int)sizeof(address.storage);
 
-	SOCKET clientSocket = ::accept(serverSocket, (sockaddr*)&acceptAddr, &addrLen);
+	SOCKET clientSocket = ::accept(serverSocket, (sockaddr*)address.storage, &addrLen);
 	if (clientSocket == INVALID_SOCKET) {
 		throw NulNetworkException(WSAGetLastError(), "Accept failed.");
 	}
 
-	Address address;
-	memcpy(address.sockAddr, &acceptAddr, sizeof(sockaddr));
+	address.length = addrLen;
 	Socket socketInstance(this->wsaConnection);
 	memcpy(socketInstance.socket, &clientSocket, sizeof(SOCKET));
 	socketInstance.ipType = address.getIpType();
@@ -158,20 +264,19 @@ Socket Socket::accept() {
 
 Socket Socket::accept(Address& clientAddress) {
 	SOCKET& serverSocket = GetSocket(this->socket);
-	sockaddr_in acceptAddr;
-	int addrLen = sizeof(SOCKADDR_IN);
+	Address address;
+	int addrLen = (int)sizeof(address.storage);
 
-	SOCKET clientSocket = ::accept(serverSocket, (sockaddr*)&acceptAddr, &addrLen);
+	SOCKET clientSocket = ::accept(serverSocket, (sockaddr*)address.storage, &addrLen);
 	if (clientSocket == INVALID_SOCKET) {
 		throw NulNetworkException(WSAGetLastError(), "Accept failed.");
 	}
 
-	Address address;
-	memcpy(address.sockAddr, &acceptAddr, sizeof(sockaddr));
+	address.length = addrLen;
 	Socket socketInstance(this->wsaConnection);
 	memcpy(socketInstance.socket, &clientSocket, sizeof(SOCKET));
 	socketInstance.ipType = address.getIpType();
-	clientAddress = std::move(address);
+	clientAddress = address;
 	return socketInstance;
 }
 
@@ -179,17 +284,96 @@ void Socket::setBlockMode(bool blocked) {
 	u_long mode = blocked ? 0 : 1;
 	SOCKET& socket = GetSocket(this->socket);
 	ioctlsocket(socket, FIONBIO, &mode);
+	if (registeredIo != nullptr) {
+		registeredIo->setBlockMode(blocked);
+	}
+}
+
+void Socket::setReceiveTimeout(unsigned long milliseconds) {
+	DWORD timeout = milliseconds;
+	SOCKET& socket = GetSocket(this->socket);
+	int res = setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	if (res == SOCKET_ERROR) {
+		throw NulNetworkException(WSAGetLastError(), "Failed to set receive timeout.");
+	}
+	if (registeredIo != nullptr) {
+		registeredIo->setReceiveTimeout(milliseconds);
+	}
+}
+
+void Socket::joinGroup(const std::string& group) {
+	SOCKET& socket = GetSocket(this->socket);
+	Address address(group, 0);
+	int res = SOCKET_ERROR;
+	if (address.getIpType() == IPType::IPv6) {
+		ipv6_mreq request;
+		std::memset(&request, 0, sizeof(request));
+		request.ipv6mr_multiaddr = ((const sockaddr_in6*)address.storage)->sin6_addr;
+		res = setsockopt(socket, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, (const char*)&request, sizeof(request));
+	} else {
+		ip_mreq request;
+		std::memset(&request, 0, sizeof(request));
+		request.imr_multiaddr = ((const sockaddr_in*)address.storage)->sin_addr;
+		request.imr_interface.s_addr = htonl(INADDR_ANY);
+		res = setsockopt(socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&request, sizeof(request));
+	}
+	if (res == SOCKET_ERROR) {
+		throw NulNetworkException(WSAGetLastError(), std::format("Failed to join multicast group {}.", group));
+	}
+}
+
+void Socket::setMulticast(unsigned long hops, bool loopback) {
+	SOCKET& socket = GetSocket(this->socket);
+	DWORD hopsValue = hops, loopbackValue = loopback ? 1 : 0;
+	int res = 0;
+	if (this->ipType == IPType::IPv6) {
+		res = setsockopt(socket, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char*)&hopsValue, sizeof(hopsValue));
+		if (res != SOCKET_ERROR) {
+			res = setsockopt(socket, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (const char*)&loopbackValue, 
+				sizeof(loopbackValue));
+		}
+	} else {
+		res = setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&hopsValue, sizeof(hopsValue));
+		if (res != SOCKET_ERROR) {
+			res = setsockopt(socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loopbackValue, sizeof(loopbackValue));
+		}
+	}
+	if (res == SOCKET_ERROR) {
+		throw NulNetworkException(WSAGetLastError(), "Failed to set multicast options.");
+	}
 }
 
 WSAConnection Socket::getWsaConnection() const {
 	return this->wsaConnection;
 }
 
+Socket::Address Socket::getLocalAddress() const {
+	SOCKET& socket = GetSocket(this->socket);
+	Address address;
+	int addrLen = (int)sizeof(address.storage);
+	if (getsockname(socket, (sockaddr*)address.storage, &addrLen) == SOCKET_ERROR) {
+		throw NulNetworkException(WSAGetLastError(), "Failed to get local address.");
+	}
+	address.length = addrLen;
+	return address;
+}
+
+void Socket::setBusyPoll(unsigned long microseconds) {
+	busyPoll.setLimit(microseconds);
+}
+
+bool Socket::isRegisteredIo() const {
+	return this->registeredIo != nullptr;
+}
+
 int Socket::receive(void* data, int length) const {
 	SOCKET& socket = GetSocket(this->socket);
 	if (socket == INVALID_SOCKET) {
 		throw NulNetworkException(0, "Invalid socket.");
 	}
+	if (registeredIo != nullptr) {
+		return registeredIo->receive(data, length, nullptr, 0);
+	}
 	int res = ::recv(socket, (char*)data, length, 0);
 	return res;
 }
@@ -199,11 +383,45 @@ int Socket::receive(void* data, int length, Address& sender) const {
 	if (socket == INVALID_SOCKET) {
 		throw NulNetworkException(0, "Invalid socket.");
 	}
-	int addrLen = sizeof(sockaddr);
-	int res = ::recvfrom(socket, (char*)data, length, 0, (sockaddr*)sender.sockAddr, &addrLen);
+	if (registeredIo != nullptr) {
+		int res = registeredIo->receive(data, length, (sockaddr*)sender.storage, (int)sizeof(sender.storage));
+		sender.length = AddressLength(*((const sockaddr_storage*)sender.storage));
+		return res;
+	}
+	int addrLen = (int)sizeof(sender.storage);
+	int res = ::recvfrom(socket, (char*)data, length, 0, (sockaddr*)sender.storage, &addrLen);
+	if (res != SOCKET_ERROR) {
+		sender.length = addrLen;
+	}
 	return res;
 }
 
+int Socket::receive(void* data, int length, unsigned long timeout) const {
+	SOCKET& socket = GetSocket(this->socket);
+	if (socket == INVALID_SOCKET) {
+		throw NulNetworkException(0, "Invalid socket.");
+	}
+	bool ready = registeredIo != nullptr ? registeredIo->poll(busyPoll, timeout) : WaitReadable(socket, busyPoll, timeout);
+	if (!ready) {
+		WSASetLastError(WSAETIMEDOUT);
+		return SOCKET_ERROR;
+	}
+	return receive(data, length);
+}
+
+int Socket::receive(void* data, int length, Address& sender, unsigned long timeout) const {
+	SOCKET& socket = GetSocket(this->socket);
+	if (socket == INVALID_SOCKET) {
+		throw NulNetworkException(0, "Invalid socket.");
+	}
+	bool ready = registeredIo != nullptr ? registeredIo->poll(busyPoll, timeout) : WaitReadable(socket, busyPoll, timeout);
+	if (!ready) {
+		WSASetLastError(WSAETIMEDOUT);
+		return SOCKET_ERROR;
+	}
+	return receive(data, length, sender);
+}
+
 void Socket::send(const void* data, int length) const {
 	SOCKET& socket = GetSocket(this->socket);
 	if (socket == INVALID_SOCKET) {
@@ -224,7 +442,13 @@ void Socket::send(const void* data, int length, const Address& targetSocketInsta
 	if (socket == INVALID_SOCKET) {
 		throw NulNetworkException(0, "Invalid socket.");
 	}
-	int res = ::sendto(socket, (const char*)data, length, 0, (sockaddr*)targetSocketInstance.sockAddr, sizeof(sockaddr));
+	int res = 0;
+	if (registeredIo != nullptr) {
+		res = registeredIo->send(data, length, (const sockaddr*)targetSocketInstance.storage, targetSocketInstance.length);
+	} else {
+		res = ::sendto(socket, (const char*)data, length, 0, (const sockaddr*)targetSocketInstance.storage, 
+			targetSocketInstance.length);
+	}
 	if (res == SOCKET_ERROR) {
 		throw NulNetworkException(WSAGetLastError(), "Failed to send message.");
 	}
@@ -243,62 +467,84 @@ void Socket::close() {
 		closesocket(socket);
 		socket = INVALID_SOCKET;
 	}
+	delete registeredIo;
+	registeredIo = nullptr;
 }
 
-Socket::Address::Address() {
-	this->sockAddr = new sockaddr;
-	std::memset(this->sockAddr, 0, sizeof(sockaddr));
+Socket::Address::Address() : length(0) {
+	static_assert(sizeof(sockaddr_storage) <= STORAGE_LENGTH, "Address storage is too small.");
+	std::memset(this->storage, 0, sizeof(this->storage));
 }
 
-Socket::Address::Address(const std::string & host, unsigned short port) {
-	this->sockAddr = new sockaddr;
-	std::memset(this->sockAddr, 0, sizeof(sockaddr));
+Socket::Address::Address(const std::string & host, unsigned short port) : Address() {
 	this->set(host, port);
 }
 
-Socket::Address::Address(const Address& other) {
-	this->sockAddr = new sockaddr;
-	std::memcpy(this->sockAddr, other.sockAddr, sizeof(sockaddr));
-}
-
-Socket::Address::Address(Address&& other) noexcept {
-	this->sockAddr = other.sockAddr;
-	other.sockAddr = nullptr;
-}
-
-Socket::Address::~Address() {
-	delete this->sockAddr;
-}
-
 void Socket::Address::set(const std::string & host, unsigned short port) {
-	int res = 0;
-
-	addrinfo hints, *resultRaw;
-	std::memset(&hints, 0, sizeof(hints));
-
-	res = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &resultRaw);
-	if (res != 0) {
-		throw NulNetworkException(GetLastError(), std::format("Failed to resolve host {}", host));
+	sockaddr_storage& address = *((sockaddr_storage*)this->storage);
+	this->length = ResolveHost(host, address);
+	switch (address.ss_family) {
+	case AF_INET:
+		((sockaddr_in*)&address)->sin_port = htons(port);
+		break;
+	case AF_INET6:
+		((sockaddr_in6*)&address)->sin6_port = htons(port);
+		break;
 	}
-
-	std::memcpy(this->sockAddr, resultRaw->ai_addr, sizeof(sockaddr));
-	freeaddrinfo(resultRaw);
 }
 
-Socket::Address& Socket::Address::operator=(Address&& other) noexcept {
-	this->sockAddr = other.sockAddr;
-	other.sockAddr = nullptr;
-	return *this;
+bool Socket::Address::operator==(const Address& other) const {
+	const sockaddr* addr = (const sockaddr*)this->storage;
+	const sockaddr* otherAddr = (const sockaddr*)other.storage;
+	if (addr->sa_family != otherAddr->sa_family) {
+		return false;
+	}
+	switch (addr->sa_family) {
+	case AF_INET: {
+		const sockaddr_in* left = (const sockaddr_in*)addr;
+		const sockaddr_in* right = (const sockaddr_in*)otherAddr;
+		return left->sin_port == right->sin_port && 
+			std::memcmp(&left->sin_addr, &right->sin_addr, sizeof(left->sin_addr)) == 0;
+	}
+	case AF_INET6: {
+		const sockaddr_in6* left = (const sockaddr_in6*)addr;
+		const sockaddr_in6* right = (const sockaddr_in6*)otherAddr;
+		return left->sin6_port == right->sin6_port && left->sin6_scope_id == right->sin6_scope_id &&
+			std::memcmp(&left->sin6_addr, &right->sin6_addr, sizeof(left->sin6_addr)) == 0;
+	}
+	}
+	return this->length == other.length && std::memcmp(this->storage, other.storage, this->length) == 0;
 }
 
-Socket::Address& Socket::Address::operator=(Address& other) {
-	memcpy(this->sockAddr, other.sockAddr, sizeof(sockaddr));
-	return *this;
+size_t Socket::Address::hash() const noexcept {
+	// FNV-1a over the same fields operator== compares.
+	const sockaddr* addr = (const sockaddr*)this->storage;
+	uint64_t result = 14695981039346656037ull;
+	auto mix = [&result](const void* data, size_t length) {
+		for (size_t i = 0; i < length; ++i) {
+			result = (result ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+		}
+	};
+	mix(&addr->sa_family, sizeof(addr->sa_family));
+	switch (addr->sa_family) {
+	case AF_INET:
+		mix(&((const sockaddr_in*)addr)->sin_port, sizeof(u_short));
+		mix(&((const sockaddr_in*)addr)->sin_addr, sizeof(in_addr));
+		break;
+	case AF_INET6:
+		mix(&((const sockaddr_in6*)addr)->sin6_port, sizeof(u_short));
+		mix(&((const sockaddr_in6*)addr)->sin6_addr, sizeof(in6_addr));
+		break;
+	default:
+		mix(this->storage, this->length);
+		break;
+	}
+	return (size_t)result;
 }
 
 IPType Socket::Address::getIpType() const {
 	IPType result = IPType::IPv4;
-	switch (((sockaddr*)this->sockAddr)->sa_family) {
+	switch (((const sockaddr*)this->storage)->sa_family) {
 	case AF_INET:
 		result = IPType::IPv4;
 		break;
@@ -310,35 +556,58 @@ IPType Socket::Address::getIpType() const {
 }
 
 std::string Socket::Address::getIp() const {
-	sockaddr* addr = (sockaddr*)this->sockAddr;
-	char* ip = nullptr;
-	std::string result;
+	const sockaddr* addr = (const sockaddr*)this->storage;
+	char ip[INET6_ADDRSTRLEN] = {};
 	switch (addr->sa_family) {
 	case AF_INET:
-		ip = new char[INET_ADDRSTRLEN];
-		inet_ntop(addr->sa_family, &((sockaddr_in*)sockAddr)->sin_addr, ip, INET_ADDRSTRLEN);
-		result = ip;
+		inet_ntop(AF_INET, &((const sockaddr_in*)addr)->sin_addr, ip, sizeof(ip));
 		break;
 	case AF_INET6:
-		ip = new char[INET6_ADDRSTRLEN];
-		inet_ntop(addr->sa_family, &((sockaddr_in6*)sockAddr)->sin6_addr, ip, INET6_ADDRSTRLEN);
-		result = ip;
+		inet_ntop(AF_INET6, &((const sockaddr_in6*)addr)->sin6_addr, ip, sizeof(ip));
 		break;
 	}
-	delete[] ip;
-	return result;
+	return ip;
 }
 
 unsigned short Socket::Address::getPort() const {
-	sockaddr* addr = (sockaddr*)this->sockAddr;
+	const sockaddr* addr = (const sockaddr*)this->storage;
 	unsigned short port = 0;
 	switch (addr->sa_family) {
 	case AF_INET:
-		port = ntohs(((sockaddr_in*)addr)->sin_port);
+		port = ntohs(((const sockaddr_in*)addr)->sin_port);
 		break;
 	case AF_INET6:
-		port = ntohs(((sockaddr_in6*)addr)->sin6_port);
+		port = ntohs(((const sockaddr_in6*)addr)->sin6_port);
 		break;
 	}
 	return port;
 }
+
+Socket::Address::Key Socket::Address::key() const {
+	Key key = {};
+	const sockaddr* addr = (const sockaddr*)this->storage;
+	switch (addr->sa_family) {
+	case AF_INET:
+		std::memcpy(key.ip, &((const sockaddr_in*)addr)->sin_addr, sizeof(in_addr));
+		key.port = ntohs(((const sockaddr_in*)addr)->sin_port);
+		key.family = 4;
+		break;
+	case AF_INET6:
+		std::memcpy(key.ip, &((const sockaddr_in6*)addr)->sin6_addr, sizeof(in6_addr));
+		key.port = ntohs(((const sockaddr_in6*)addr)->sin6_port);
+		key.family = 6;
+		break;
+	}
+	return key;
+}
+
+bool Socket::Address::isMulticast() const {
+	const sockaddr* addr = (const sockaddr*)this->storage;
+	switch (addr->sa_family) {
+	case AF_INET:
+		return IN_MULTICAST(ntohl(((const sockaddr_in*)addr)->sin_addr.s_addr));
+	case AF_INET6:
+		return IN6_IS_ADDR_MULTICAST(&((const sockaddr_in6*)addr)->sin6_addr);
+	}
+	return false;
+}
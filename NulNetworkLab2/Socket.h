@@ -1,7 +1,11 @@
 #pragma once
 #include <string>
 #include <functional>
+#include <cstdint>
 #include "WSAConnection.h"
+#include "BusyPoll.h"
+
+class RegisteredIo;
 
 class Socket final {
 public:
@@ -20,25 +24,40 @@ public:
 		UDP
 	};
 
+	// Socket address stored inline, so copies are plain memory copies. Two addresses are equal when
+	// family, IP and port match, and std::hash lets them key hash containers directly.
 	class Address final {
 	public:
+		// Family, IP and port packed into 20 bytes, for tables that keep very many peers. IPv4 addresses
+		// fill the first 4 bytes of `ip` and leave the rest zero.
+		struct Key {
+			uint8_t ip[16];
+			uint16_t port;
+			uint8_t family;
+			bool operator==(const Key& other) const = default;
+		};
+
 		Address();
 		Address(const std::string& host, unsigned short port);
-		Address(const Address& other);
-		Address(Address&& other) noexcept;
-		~Address();
 
+		// Host names go through a process-wide cache instead of a DNS lookup on every call.
 		void set(const std::string& host, unsigned short port);
 
-		Address& operator=(Address&& other) noexcept;
-		Address& operator=(Address& other);
+		bool operator==(const Address& other) const;
+		size_t hash() const noexcept;
 
 		IPType getIpType() const;
 		std::string getIp() const;
 		unsigned short getPort() const;
+		bool isMulticast() const;
+		Key key() const;
 
 	private:
-		void* sockAddr;
+		// Large enough for sockaddr_storage, which Socket.cpp checks.
+		static constexpr size_t STORAGE_LENGTH = 128;
+
+		alignas(8) unsigned char storage[STORAGE_LENGTH];
+		int length;
 		friend class Socket;
 	};
 
@@ -50,6 +69,10 @@ public:
 	Socket accept(Address& clientAddress);
 	int receive(void* data, int length) const;
 	int receive(void* data, int length, Address& sender) const;
+	// Waits at most `timeout` milliseconds for a datagram, whatever the block mode; returns SOCKET_ERROR
+	// with WSAETIMEDOUT when nothing arrived.
+	int receive(void* data, int length, unsigned long timeout) const;
+	int receive(void* data, int length, Address& sender, unsigned long timeout) const;
 	void send(const void* data, int length) const;
 	void send(const std::string& data) const;
 	void send(const void* data, int length, const Address& target) const;
@@ -57,11 +80,30 @@ public:
 	void close();
 
 	void setBlockMode(bool blocked);
+	void setReceiveTimeout(unsigned long milliseconds);
+	// Opt-in: spin for up to this many microseconds before blocking in the deadline receives.
+	void setBusyPoll(unsigned long microseconds);
+	// Joins the multicast group `group` on the default interface; the socket must be bound to the port the
+	// group is sent to.
+	void joinGroup(const std::string& group);
+	// Hop limit of the multicast datagrams this socket sends, and whether they loop back to the local host.
+	void setMulticast(unsigned long hops, bool loopback);
 	WSAConnection getWsaConnection() const;
+	Address getLocalAddress() const;
+	bool isRegisteredIo() const;
 
 private:
 	void* socket;
+	RegisteredIo* registeredIo;
+	mutable BusyPoll busyPoll;
 	IPType ipType;
 	WSAConnection wsaConnection;
+	friend class EventLoop;
 };
 
+template<>
+struct std::hash<Socket::Address> {
+	size_t operator()(const Socket::Address& address) const noexcept {
+		return address.hash();
+	}
+};
@@ -1,324 +1,314 @@
 #include "stdafx.h"
 #include "SrProtocol.h"
+#include "SrStatus.h"
 #include <format>
 #include <random>
 #include <cstdint>
+#include <algorithm>
 #include "util.h"
+#include "UdpPacket.h"
+#include "PacketPool.h"
 
-constexpr size_t SR_BUFFER_LENGTH = 1026;
-constexpr size_t SR_DATA_LENGTH = 1024;
-constexpr uint8_t SR_SEQ_SIZE = 16;
-constexpr uint8_t SR_SEND_WINDOW_SIZE = 8;
-constexpr uint8_t SR_RECEIVE_WINDOW_SIZE = 8;
+constexpr size_t SR_BUFFER_LENGTH = UdpPacket::MAX_LENGTH;
+constexpr size_t SR_DATA_LENGTH = UdpPacket::MAX_DATA_LENGTH;
 constexpr uint32_t SR_MAX_END_ATTEMPT = 5;
 constexpr uint16_t SR_MAX_WAIT_COUNT = 20;
+constexpr uint32_t SR_MAX_HANDSHAKE_ATTEMPT = 5;
+constexpr uint32_t SR_MAX_IDLE_COUNT = 30;
+constexpr uint32_t SR_MAX_SERVER_IDLE_COUNT = 60;
+constexpr unsigned long SR_RECEIVE_TIMEOUT = 1000;
 
 enum class SrStage {
 	CHECK_STATUS,
-	WAIT_FOR_RESPONSE,
 	DATA_TRANSMISSION,
-	END_TRANSMISSION,
 	CLOSED
 };
 
-struct SrStatus {
-	uint16_t waitCount[SR_SEQ_SIZE];				// ݰļʱ
-	bool ack[SR_SEQ_SIZE], send[SR_SEQ_SIZE];		// Ѿȷϵźͷͱ־
-	uint8_t curSeq;									// ǰ
-	uint32_t totalSeq;								// ǰڵλ
-	uint8_t endAttempt;								// ͽݰĴ
-
-	typedef std::function<void(uint8_t seq, uint32_t totalSeq)> SrStatusCallback;
-
-	SrStatus() {
-		clear();
-	}
-
-	void clear() {
-		std::memset(waitCount, 0, sizeof(waitCount));
-		std::memset(ack, 0, sizeof(ack));
-		std::memset(send, 0, sizeof(send));
-		curSeq = 0;
-		totalSeq = 0;
-		endAttempt = 0;
-	}
-
-	void forEachElementInWindow(SrStatusCallback callback) const {
-		for (uint8_t i = 0; i < SR_SEND_WINDOW_SIZE; ++i) {
-			uint8_t seq = ((uint16_t)i + this->curSeq) % SR_SEQ_SIZE;
-			uint32_t totalSeq = this->totalSeq + i;
-			callback(seq, totalSeq);
-		}
-	}
-
-	bool hasData(const std::string& data) {
-		return hasData(data, totalSeq);
-	}
-
-	bool hasData(const std::string& data, uint32_t totalSeq) {
-		size_t offset = totalSeq * SR_DATA_LENGTH;
-		if (offset >= data.size()) {
-			return false;
-		}
-		return true;
-	}
-
-	// 
-	bool moveWindow() {
-		uint8_t i = 0;
-		for (; i < SR_SEND_WINDOW_SIZE; ++i) {
-			uint8_t seq = ((uint16_t)i + this->curSeq) % SR_SEQ_SIZE;
-			uint32_t totalSeq = this->totalSeq + i;
-			if (ack[seq]) {
-				ack[seq] = false;
-				waitCount[seq] = 0;
-			} else {
-				break;
-			}
-		}
-
-		this->curSeq = ((uint16_t)i + this->curSeq) % SR_SEQ_SIZE;
-		this->totalSeq = this->totalSeq + i;
-		return i > 0;
-	}
-};
-
-struct SrReceiveStatus {
-	uint8_t seq;									// ǰλ
-	bool received[SR_SEQ_SIZE];						// Ƿյݰ
-	std::string receivedString[SR_SEQ_SIZE];		// յ
-	uint32_t totalSeq;								// Ѿյݰ
-
-	SrReceiveStatus() {
-		clear();
-	}
-
-	void clear() {
-		seq = 0;
-		std::memset(received, 0, sizeof(received));
-		totalSeq = 0;
-	}
-
-	bool isWithinWindow(uint8_t seq) {
-		uint16_t start = this->seq, end = (uint16_t)this->seq + SR_RECEIVE_WINDOW_SIZE;
-		return (seq >= start && seq < end) || (seq < start && (uint16_t)seq + SR_SEQ_SIZE < end);
-	}
-
-	bool accept(std::string& result, uint8_t seq, uint8_t* buffer, int length) {
-		received[seq] = true;
-		receivedString[seq] = std::string((char*)buffer, length);
-
-		// ϲһλ
-		uint8_t i = 0;
-		for (; i < SR_RECEIVE_WINDOW_SIZE; ++i) {
-			uint8_t seq = ((uint16_t)i + this->seq) % SR_SEQ_SIZE;
-			uint32_t totalSeq = this->totalSeq + i;
-
-			if (received[seq]) {
-				received[seq] = false;
-				result += this->receivedString[seq];
-			} else {
-				break;
-			}
-		}
-
-		this->seq = ((uint16_t)i + this->seq) % SR_SEQ_SIZE;
-		this->totalSeq = this->totalSeq + i;
-		return i > 0;
-	}
-};
-
 namespace {
-	size_t GetDataBuffer(uint8_t* buffer, const std::string& data, uint32_t totalSeq) {
-		size_t offset = totalSeq * SR_DATA_LENGTH;
+	int GetDataPacket(uint8_t* buffer, const std::string& data, uint64_t start, uint16_t dataLength, uint8_t seq, 
+		uint32_t totalSeq) {
+		size_t offset = (size_t)start + (size_t)totalSeq * dataLength;
 		if (offset >= data.size()) {
 			return 0;
 		}
-		std::string send = data.substr(offset, SR_DATA_LENGTH);
-		std::memcpy(buffer, send.c_str(), send.size() * sizeof(uint8_t));
-		return send.size();
+		size_t length = std::min<size_t>(dataLength, data.size() - offset);
+		return UdpPacket::write(buffer, UdpPacket::Type::DATA, seq, data.data() + offset, length);
 	}
 }
 
-SrProtocol::SrProtocol(WSAConnection wsaConnection) : UdpReliableProtocol(wsaConnection) {}
+SrProtocol::SrProtocol(WSAConnection wsaConnection) 
+	: UdpReliableProtocol(wsaConnection, { UdpPacket::Protocol::SR, SR_SEND_WINDOW_SIZE, SR_DATA_LENGTH }) {}
 
-void SrProtocol::response(const Socket& socket, const Socket::Address& target, const std::string& data) {
+Task<void> SrProtocol::responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+	const std::string& data) {
+	// ʹڲܳմ
+	UdpPacket::Parameters accepted = negotiate(SR_RECEIVE_WINDOW_SIZE, SR_DATA_LENGTH, data.size());
+	size_t remaining = data.size() - (size_t)accepted.offset;
+	uint32_t segmentCount = (uint32_t)((remaining + accepted.dataLength - 1) / accepted.dataLength) + 1;
+	bool timeout = false, acked = false;
 	SrStage stage = SrStage::CHECK_STATUS;
-	SrStatus status;
-	std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(SR_BUFFER_LENGTH);
+	SrStatus status((uint8_t)accepted.windowSize, segmentCount);
+	PacketBuffer buffer = PacketPool::local().acquire();
+	PacketBuffer segments[SR_SEQ_SIZE];
+	UdpPacket::Header header;
+	uint32_t next = 0;
+	uint16_t window = 0;
 	int res = 0;
 
 	while (stage != SrStage::CLOSED) {
 		switch (stage) {
 		case SrStage::CHECK_STATUS:
-			buffer[0] = 205;
-			socket.send(buffer.get(), 1, target);
-			logger("[Server] Sent handshake request");
-			stage = SrStage::WAIT_FOR_RESPONSE;
-			break;
-		case SrStage::WAIT_FOR_RESPONSE:
-			res = socket.receive(buffer.get(), SR_BUFFER_LENGTH);
-			if (res <= 0) {
-				++status.waitCount[0];
-				if (status.waitCount[0] >= SR_MAX_WAIT_COUNT) {
-					stage = SrStage::CLOSED;
-					logger("[Server] Timeout error");
-				}
-				util::sleep(500);
-			} else {
-				if (buffer[0] == 200) {
-					status.clear();
-					stage = SrStage::DATA_TRANSMISSION;
-					logger("[Server] Begin file transmission");
-				}
-			}
+			// ȷϴֱӷ͵һڵݣȴͻ˻Ӧ
+			res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+			trace(PacketTracer::Side::SERVER, PacketTracer::Event::SEND, accepted.transferId, 0, res, 
+				UdpPacket::Type::HANDSHAKE_ACK);
+			socket.send(buffer.get(), res, target);
+			logger(std::format("[Server] Accepted transfer {} at offset {}, window size {}, data length {}", 
+				accepted.transferId, accepted.offset, accepted.windowSize, accepted.dataLength));
+			stage = SrStage::DATA_TRANSMISSION;
 			break;
 		case SrStage::DATA_TRANSMISSION:
 
-			// 鴰ڵݰڷ͵ʱ·
-			status.forEachElementInWindow([&](uint8_t seq, uint32_t totalSeq) {
-				if (!status.hasData(data, totalSeq)) {
-					return;
-				}
-				if (!status.ack[seq]) {
-					++status.waitCount[seq];
-					if (status.waitCount[seq] >= SR_MAX_WAIT_COUNT) {
-						logger(std::format("[Server] Data seq {} timeout, reset package", seq));
-						status.waitCount[seq] = 0;
-						status.send[seq] = false;
-					}
-				}
+			// 鷢͹ݰļʱʱݰ·
+			++status.tick;
+			timeout = false;
+			status.forEachExpired([&](uint8_t seq, uint32_t totalSeq) {
+				logger(std::format("[Server] Data seq {} timeout, reset package", seq));
+				trace(PacketTracer::Side::SERVER, PacketTracer::Event::TIMEOUT, accepted.transferId, seq, 0, 
+					status.isEnd(totalSeq) ? UdpPacket::Type::END : UdpPacket::Type::DATA);
+				timeout = true;
 			});
 
-			// ͵ǰڻûз͹ݰ
-			status.forEachElementInWindow([&](uint8_t seq, uint32_t totalSeq) {
-				if (!status.send[seq]) {
-					size_t size = GetDataBuffer(&buffer[1], data, totalSeq);
-					if (size > 0) {
-						status.send[seq] = true;
-						status.waitCount[seq] = 0;
-						buffer[0] = seq;
-						socket.send(buffer.get(), (int)size + 1, target);
-						logger(std::format("[Server] Sent data package seq {}", seq));
+			// ͻ˻ûлӦֻӦѾʧ·
+			if (timeout && !status.confirmed) {
+				res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+				trace(PacketTracer::Side::SERVER, PacketTracer::Event::RETRANSMIT, accepted.transferId, 0, res, 
+					UdpPacket::Type::HANDSHAKE_ACK);
+				socket.send(buffer.get(), res, target);
+			}
+
+			// ͵ǰڻûз͹ݰݰΪһݰһͬ
+			status.forEachUnsent([&](uint8_t seq, uint32_t totalSeq) {
+				bool isEnd = status.isEnd(totalSeq);
+				if (isEnd) {
+					if (status.endAttempt >= SR_MAX_END_ATTEMPT) {
+						logger(std::format("[Server] Attempt failed for {} times, terminating connection", 
+							SR_MAX_END_ATTEMPT));
+						stage = SrStage::CLOSED;
+						return;
 					}
+					++status.endAttempt;
+					logger(std::format("[Server] Sent end request #{}, {} remaining", status.endAttempt, 
+						SR_MAX_END_ATTEMPT - status.endAttempt));
+				} else {
+					logger(std::format("[Server] Sent data package seq {}", seq));
+				}
+
+				// ݰֻڵһηʱװұյ ACK Ϊֹشʱֱӷͱݰ
+				PacketBuffer& segment = segments[seq];
+				if (!segment) {
+					segment = PacketPool::local().acquire();
+					segment.setSize(isEnd ? UdpPacket::write(segment.get(), UdpPacket::Type::END, seq) : 
+						GetDataPacket(segment.get(), data, accepted.offset, accepted.dataLength, seq, totalSeq));
 				}
+				status.markSent(seq, status.tick + SR_MAX_WAIT_COUNT);
+				trace(PacketTracer::Side::SERVER, status.isRetransmitted(seq) ? PacketTracer::Event::RETRANSMIT : 
+					PacketTracer::Event::SEND, accepted.transferId, seq, segment.size(), 
+					isEnd ? UdpPacket::Type::END : UdpPacket::Type::DATA);
+				socket.send(segment.get(), segment.size(), target);
 			});
 
 			//  ACK 
-			while ((res = socket.receive(buffer.get(), 1)) > 0) {
-				uint8_t ack = buffer[0];
-				status.ack[ack] = true;
+			acked = false;
+			while ((res = socket.receive(buffer.get(), SR_BUFFER_LENGTH)) > 0) {
+				if (!UdpPacket::read(buffer.get(), res, header)) {
+					continue;
+				}
+
+				// ͻ˴ݰ֪ѾʼûյֻӦ·
+				if (header.type == UdpPacket::Type::HANDSHAKE) {
+					UdpPacket::Parameters request;
+					if (UdpPacket::readParameters(buffer.get(), header, request) && 
+						request.transferId == accepted.transferId) {
+						res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, accepted);
+						trace(PacketTracer::Side::SERVER, PacketTracer::Event::RETRANSMIT, accepted.transferId, 0, res, 
+							UdpPacket::Type::HANDSHAKE_ACK);
+						socket.send(buffer.get(), res, target);
+					}
+					continue;
+				}
+				if (header.type != UdpPacket::Type::ACK) {
+					continue;
+				}
+				trace(PacketTracer::Side::SERVER, PacketTracer::Event::RECEIVE, accepted.transferId, header.seq, res, 
+					UdpPacket::Type::ACK);
+				if (header.seq >= SR_SEQ_SIZE || !status.isWithinWindow((uint8_t)header.seq)) {
+					continue;
+				}
+				uint8_t ack = (uint8_t)header.seq;
+				if (UdpPacket::readWindow(buffer.get(), header, next, window)) {
+					status.advertise(next, window);
+				}
+				status.acknowledge(ack);
+				segments[ack].reset();
+				status.confirmed = true;
+				acked = true;
 				logger(std::format("[Server] Received ack {}", ack));
 			}
 
+			// ͻ˳ʱûлӦ䣬һֱռù߳
+			if (acked) {
+				status.idleCount = 0;
+			} else if (++status.idleCount >= SR_MAX_SERVER_IDLE_COUNT) {
+				logger("[Server] Client is not responding, terminating connection");
+				stage = SrStage::CLOSED;
+				break;
+			}
+
 			// 
 			if (status.moveWindow()) {
 				logger(std::format("[Server] Moved send window, current seq is {}", status.curSeq));
 			}
 
-			if (!status.hasData(data)) {
-				stage = SrStage::END_TRANSMISSION;
-				status.endAttempt = 0;
-				std::memset(buffer.get(), 0, SR_BUFFER_LENGTH);
-				logger("[Server] Transmission success, attempt to end connection");
-			}
-
-			util::sleep(500);
-
-			break;
-		case SrStage::END_TRANSMISSION:
-			if (status.endAttempt >= SR_MAX_END_ATTEMPT) {
+			// ݰҲѾȷ
+			if (!status.hasData()) {
+				logger("[Server] Received end ack, closing connection");
 				stage = SrStage::CLOSED;
 				break;
 			}
-			++status.endAttempt;
-			buffer[0] = status.curSeq + 1;
-			socket.send(buffer.get(), 1, target);
-			logger(std::format("[Server] Sent end request #{}, {} remaining", status.endAttempt, SR_MAX_END_ATTEMPT - status.endAttempt));
 
-			for (int i = 0; i < SR_MAX_WAIT_COUNT; ++i) {
-				res = socket.receive(buffer.get(), SR_BUFFER_LENGTH);
-				if (res > 0 && buffer[0] == status.curSeq + 1) {
-					logger("[Server] Received end ack, closing connection");
-					stage = SrStage::CLOSED;
-					break;
-				}
-				util::sleep(500);
-			}
+			co_await loop.sleep(500);
 
-			util::sleep(500);
 			break;
 		}
 	}
 	logger("[Server] Test SR protocol end");
 }
 
-std::string SrProtocol::receive(const std::string& host, unsigned short port, double loss, double ackLoss) {
+Task<bool> SrProtocol::transferAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+	double ackLoss, std::string& result) {
 	Socket socket(wsaConnection);
 	socket.init(Socket::ProtocolType::UDP);
-	Socket::Address target(host, port);
+	Socket::Address sender, target(host, port);
 	std::random_device randomDevice;
 	std::default_random_engine engine(randomDevice());
 	std::bernoulli_distribution lossRandom(loss), ackLossRandom(ackLoss);
 	
-	std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(SR_BUFFER_LENGTH);
-	std::string result;
+	PacketBuffer buffer = PacketPool::local().acquire();
 	SrReceiveStatus status;
 	SrStage stage = SrStage::CHECK_STATUS;
+	UdpPacket::Header header;
 	int res = 0;
+	uint32_t handshakeAttempt = 1, idleCount = 0;
+	uint64_t offset = result.size();
 	uint8_t seq = 0;
+	bool handshakeLost = false;
 
-	socket.send("-testsr", target);
+	socket.setBlockMode(false);
+	sendHandshake(socket, target, buffer.get(), offset);
 
 	while (stage != SrStage::CLOSED) {
-		res = socket.receive(buffer.get(), SR_BUFFER_LENGTH);
+		res = (co_await loop.receive(socket, buffer.get(), SR_BUFFER_LENGTH, sender, SR_RECEIVE_TIMEOUT)).length;
 		if (res <= 0) {
+			// Ӧʧ·
+			if (stage == SrStage::CHECK_STATUS) {
+				if (handshakeAttempt >= SR_MAX_HANDSHAKE_ATTEMPT) {
+					logger("[Client] Handshake timeout");
+					stage = SrStage::CLOSED;
+				} else {
+					++handshakeAttempt;
+					sendHandshake(socket, target, buffer.get(), offset);
+				}
+			} else if (++idleCount >= SR_MAX_IDLE_COUNT) {
+				// ʱûзݣδ䣬Ժѽյλü
+				logger("[Client] Transfer timeout");
+				stage = SrStage::CLOSED;
+			}
 			continue;
 		}
-
-		switch (stage) {
-		case SrStage::CHECK_STATUS:
-			if (buffer[0] == 205) {
-				buffer[0] = 200;
-				socket.send(buffer.get(), 1, target);
-				logger("[Client] 200 OK, start receiving data");
+		if (!UdpPacket::read(buffer.get(), res, header)) {
+			continue;
+		}
+		idleCount = 0;
+
+		// µĴУֻӦܶʧʱյݰͬʾѾ˴
+		// ʱȴֻӦȷϷʼ͵λ
+		// Ϊÿδʹõ׽֣֮ Ack ͵ӦԴ
+		if (stage == SrStage::CHECK_STATUS) {
+			if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, header.seq, res, header.type);
+				UdpPacket::Parameters accepted;
+				if (acceptHandshake(buffer.get(), header, result, accepted)) {
+					stage = SrStage::DATA_TRANSMISSION;
+					target = sender;
+				}
+				continue;
+			}
+			if (offset == 0 && (header.type == UdpPacket::Type::DATA || header.type == UdpPacket::Type::END)) {
 				stage = SrStage::DATA_TRANSMISSION;
+				target = sender;
+				handshakeLost = true;
 			}
-			break;
+		} else if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+			// ٵֻӦֻ¼ݵܳȺͰ汾жܴ֮ѽյλü
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, header.seq, res, header.type);
+			recordHandshake(buffer.get(), header);
+			continue;
+		}
+
+		switch (stage) {
 		case SrStage::DATA_TRANSMISSION:
-			seq = buffer[0];
+			if ((header.type != UdpPacket::Type::DATA && header.type != UdpPacket::Type::END) || header.seq >= SR_SEQ_SIZE) {
+				break;
+			}
+			seq = (uint8_t)header.seq;
 			if (lossRandom(engine)) {
 				logger(std::format("[Client] Lost data package seq {}", seq));
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::DROP, transferId, seq, res, header.type);
 				break;
 			}
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::RECEIVE, transferId, seq, res, header.type);
 			logger(std::format("[Client] Received data package seq {}", seq));
 
 			// ȷڴ
 			if (status.isWithinWindow(seq)) {
-				if (res == 1) {
-					logger(std::format("[Client] Accepted end request {}, closing connection", seq));
-					stage = SrStage::CLOSED;
-				} else if (status.accept(result, seq, &buffer[1], res - 1)) {
+				bool isEnd = header.type == UdpPacket::Type::END;
+				if (status.accept(result, seq, UdpPacket::data(buffer.get()), header.length, isEnd)) {
 					logger(std::format("[Client] Accepted data package {}, current total seq is {}", seq, status.totalSeq));
 				} else {
 					logger(std::format("[Client] Saved data package {}, current total seq is {}", seq, status.totalSeq));
 				}
+
+				// ݰ֮ǰѾȫ
+				if (status.finished) {
+					logger(std::format("[Client] Accepted end request {}, closing connection", seq));
+					stage = SrStage::CLOSED;
+				}
 			} else {
 				logger(std::format("[Client] Data package {} is not in receive window and will be ignored", seq));
 			}
 
-			//  ACK
+			//  ACKͬʱͨմʣĿռ
+			res = UdpPacket::writeAck(buffer.get(), seq, status.totalSeq, receiveWindow(SR_RECEIVE_WINDOW_SIZE));
 			if (ackLossRandom(engine)) {
 				logger(std::format("[Client] Lost ack {}", seq));
+				trace(PacketTracer::Side::CLIENT, PacketTracer::Event::DROP, transferId, seq, res, UdpPacket::Type::ACK);
 				break;
 			}
 			logger(std::format("[Client] Sent ack {} ", seq));
-			socket.send(buffer.get(), 1, target);
+			trace(PacketTracer::Side::CLIENT, PacketTracer::Event::SEND, transferId, seq, res, UdpPacket::Type::ACK);
+			socket.send(buffer.get(), res, target);
 			break;
 		}
+
+		// ֻӦʧˣʹõ׽һΣյ·ֻӦ
+		if (handshakeLost && stage != SrStage::CLOSED) {
+			handshakeLost = false;
+			sendHandshake(socket, target, buffer.get(), offset);
+		}
 	}
 
 	logger("[Client] Connection closed");
 
-	return result;
+	co_return status.finished;
 }
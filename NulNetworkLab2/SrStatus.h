@@ -0,0 +1,218 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <bit>
+#include <algorithm>
+
+// Window bookkeeping of the SR protocol, shared by SrProtocol and the benchmarks.
+//
+// Both windows keep their per-segment flags in 64-bit masks whose bit i stands for the i-th segment of
+// the window, so sliding the window is one shift and the visitors only touch the bits that are set.
+
+constexpr uint8_t SR_SEQ_SIZE = 16;
+constexpr uint8_t SR_SEND_WINDOW_SIZE = 8;
+constexpr uint8_t SR_RECEIVE_WINDOW_SIZE = 8;
+
+static_assert(SR_SEQ_SIZE <= 64, "Window masks hold one bit per sequence number.");
+
+// ǰ count ݰӦ
+constexpr uint64_t SrLowBits(unsigned count) {
+	return count >= 64 ? ~0ull : (1ull << count) - 1;
+}
+
+// ǰ count ݰ֮
+constexpr uint64_t SrShiftOut(uint64_t mask, unsigned count) {
+	return count >= 64 ? 0 : mask >> count;
+}
+
+struct SrStatus {
+	uint64_t acked;									// Ѿȷϵݰ
+	uint64_t sent;									// ѾͲһڼʱݰ
+	uint64_t retransmitted;							// гʱ֮ȴشݰ
+	uint32_t deadline[SR_SEQ_SIZE];					// ųʱʱ̣ԷѭĴ
+	uint32_t tick;									// ǰѭĴ
+	uint32_t nextDeadline;							// ܳʱʱ̣֮ǰؼʱ
+	uint8_t curSeq;									// ǰ
+	uint32_t totalSeq;								// ǰڵλ
+	uint8_t endAttempt;								// ͽݰĴ
+	uint32_t idleCount;								// ûյ ACK Ĵ
+	uint8_t windowSize;								// Э̺ķʹڴС
+	uint32_t windowNext;							// շͨѾ˳յݰ
+	uint32_t windowEnd;								// շͨĴұ߽磬֮ǰݰſԷ
+	uint32_t segmentCount;							// ݰһΪݰ
+	bool confirmed;									// ǷѾյͻ˵ ACK
+
+	SrStatus(uint8_t windowSize, uint32_t segmentCount) : windowSize(windowSize), segmentCount(segmentCount) {
+		clear();
+	}
+
+	void clear() {
+		acked = 0;
+		sent = 0;
+		retransmitted = 0;
+		std::memset(deadline, 0, sizeof(deadline));
+		tick = 0;
+		nextDeadline = UINT32_MAX;
+		curSeq = 0;
+		totalSeq = 0;
+		endAttempt = 0;
+		idleCount = 0;
+		windowNext = 0;
+		windowEnd = UINT32_MAX;
+		confirmed = false;
+	}
+
+	// մе˳еݰΪźݰ
+	template<typename Visitor>
+	void forEach(uint64_t mask, Visitor&& visitor) const {
+		while (mask != 0) {
+			unsigned offset = (unsigned)std::countr_zero(mask);
+			mask &= mask - 1;
+			visitor((uint8_t)((curSeq + offset) % SR_SEQ_SIZE), totalSeq + offset);
+		}
+	}
+
+	template<typename Visitor>
+	void forEachElementInWindow(Visitor&& visitor) const {
+		forEach(SrLowBits(windowSize), visitor);
+	}
+
+	// лݲҽշܹյĲ֣շûпռʱȻԷ͵һݰ̽ⴰǷ´
+	uint64_t dataMask() const {
+		uint32_t count = std::min<uint32_t>(windowSize, segmentCount - std::min(totalSeq, segmentCount));
+		uint32_t open = windowEnd > totalSeq ? windowEnd - totalSeq : 1;
+		return SrLowBits((unsigned)std::min(count, open));
+	}
+
+	// ʴлûз͹ݰʱҪش
+	template<typename Visitor>
+	void forEachUnsent(Visitor&& visitor) const {
+		forEach(dataMask() & ~sent & ~acked, visitor);
+	}
+
+	// ѾʱݰұΪҪشûݰʱʱ
+	template<typename Visitor>
+	void forEachExpired(Visitor&& visitor) {
+		if (tick < nextDeadline) {
+			return;
+		}
+		nextDeadline = UINT32_MAX;
+		forEach(sent & ~acked, [&](uint8_t seq, uint32_t totalSeq) {
+			if (deadline[seq] > tick) {
+				nextDeadline = std::min(nextDeadline, deadline[seq]);
+				return;
+			}
+			uint64_t bit = 1ull << offsetOf(seq);
+			sent &= ~bit;
+			retransmitted |= bit;
+			visitor(seq, totalSeq);
+		});
+	}
+
+	void markSent(uint8_t seq, uint32_t deadline) {
+		sent |= 1ull << offsetOf(seq);
+		this->deadline[seq] = deadline;
+		nextDeadline = std::min(nextDeadline, deadline);
+	}
+
+	void acknowledge(uint8_t seq) {
+		acked |= 1ull << offsetOf(seq);
+	}
+
+	// ½շͨĴڣ򵽴ľͨ治Ḳµ
+	void advertise(uint32_t next, uint16_t window) {
+		if (next >= windowNext) {
+			windowNext = next;
+			windowEnd = next + window;
+		}
+	}
+
+	bool isRetransmitted(uint8_t seq) const {
+		return (retransmitted >> offsetOf(seq)) & 1;
+	}
+
+	bool hasData() const {
+		return hasData(totalSeq);
+	}
+
+	bool hasData(uint32_t totalSeq) const {
+		return totalSeq < segmentCount;
+	}
+
+	bool isEnd(uint32_t totalSeq) const {
+		return totalSeq + 1 == segmentCount;
+	}
+
+	bool isWithinWindow(uint8_t seq) const {
+		return offsetOf(seq) < windowSize;
+	}
+
+	// ڣԽͷȷϵݰ
+	bool moveWindow() {
+		unsigned count = (unsigned)std::countr_one(acked);
+		acked = SrShiftOut(acked, count);
+		sent = SrShiftOut(sent, count);
+		retransmitted = SrShiftOut(retransmitted, count);
+		this->curSeq = (uint8_t)((curSeq + count) % SR_SEQ_SIZE);
+		this->totalSeq = this->totalSeq + count;
+		return count > 0;
+	}
+
+private:
+	unsigned offsetOf(uint8_t seq) const {
+		return (unsigned)(seq + SR_SEQ_SIZE - curSeq) % SR_SEQ_SIZE;
+	}
+};
+
+struct SrReceiveStatus {
+	uint8_t seq;									// ǰλ
+	uint64_t received;								// Ѿյݰ
+	uint64_t end;									// յĽݰ
+	std::string receivedString[SR_SEQ_SIZE];		// յ
+	uint32_t totalSeq;								// Ѿյݰ
+	bool finished;									// ǷѾ˳յ˽ݰ
+
+	SrReceiveStatus() {
+		clear();
+	}
+
+	void clear() {
+		seq = 0;
+		received = 0;
+		end = 0;
+		totalSeq = 0;
+		finished = false;
+	}
+
+	bool isWithinWindow(uint8_t seq) {
+		return (unsigned)(seq + SR_SEQ_SIZE - this->seq) % SR_SEQ_SIZE < SR_RECEIVE_WINDOW_SIZE;
+	}
+
+	bool accept(std::string& result, uint8_t seq, uint8_t* buffer, int length, bool isEnd) {
+		uint64_t bit = 1ull << ((unsigned)(seq + SR_SEQ_SIZE - this->seq) % SR_SEQ_SIZE);
+		received |= bit;
+		if (isEnd) {
+			end |= bit;
+		}
+		// ֮ǰĻÿݰ·
+		receivedString[seq].assign((char*)buffer, length);
+
+		// ϲڿͷյݣһλ
+		unsigned count = (unsigned)std::countr_one(received);
+		for (unsigned i = 0; i < count; ++i) {
+			if ((end >> i) & 1) {
+				finished = true;
+				count = i + 1;
+				break;
+			}
+			result += receivedString[(this->seq + i) % SR_SEQ_SIZE];
+		}
+
+		received = SrShiftOut(received, count);
+		end = SrShiftOut(end, count);
+		this->seq = (uint8_t)((this->seq + count) % SR_SEQ_SIZE);
+		this->totalSeq = this->totalSeq + count;
+		return count > 0;
+	}
+};
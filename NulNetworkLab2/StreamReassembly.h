@@ -0,0 +1,48 @@
+#pragma once
+#include "UdpPacket.h"
+#include <string>
+#include <map>
+#include <cstdint>
+
+// Receive side of one byte stream whose DATA and END packets carry their offset and may arrive out of
+// order, more than once, or not at all. Data is appended as soon as it is contiguous; the END fixes the
+// length of the stream. Packets that contradict what was already received are ignored: an END before
+// data already held or a second END elsewhere, and data past the end.
+struct StreamReassembly {
+	std::string data;								// Contiguous data received so far.
+	std::map<uint64_t, std::string> pending;		// Data that arrived ahead of a gap, by offset.
+	uint64_t endOffset = 0;
+	bool hasEnd = false;
+	bool finished = false;
+
+	// True only for the packet that completes the stream.
+	bool accept(const UdpPacket::Header& header, const uint8_t* buffer) {
+		if (finished) {
+			return false;
+		}
+
+		if (header.type == UdpPacket::Type::END) {
+			if (header.offset < data.size() || (hasEnd && header.offset != endOffset) ||
+				(!pending.empty() && pending.rbegin()->first + pending.rbegin()->second.size() > header.offset)) {
+				return false;
+			}
+			hasEnd = true;
+			endOffset = header.offset;
+		} else if (hasEnd && header.offset + header.length > endOffset) {
+			return false;
+		} else if (header.offset >= data.size() && !pending.contains(header.offset)) {
+			pending.emplace(header.offset, std::string((const char*)buffer, header.length));
+		}
+
+		while (!pending.empty() && pending.begin()->first <= data.size()) {
+			auto iter = pending.begin();
+			if (iter->first == data.size()) {
+				data += iter->second;
+			}
+			pending.erase(iter);
+		}
+
+		finished = hasEnd && data.size() == endOffset;
+		return finished;
+	}
+};
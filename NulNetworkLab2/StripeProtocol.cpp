@@ -0,0 +1,542 @@
+#include "stdafx.h"
+#include "StripeProtocol.h"
+#include <format>
+#include <random>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <charconv>
+#include "util.h"
+#include "PacketPool.h"
+#include "StreamReassembly.h"
+
+constexpr size_t STRIPE_BUFFER_LENGTH = UdpPacket::MAX_LENGTH;
+constexpr size_t STRIPE_DATA_LENGTH = UdpPacket::MAX_DATA_LENGTH;
+constexpr uint16_t STRIPE_WINDOW_SIZE = 16;
+constexpr uint16_t STRIPE_MAX_WINDOW_SIZE = 256;
+constexpr size_t STRIPE_MAX_SUBFLOWS = 8;
+constexpr uint32_t STRIPE_MAX_RETRANSMIT = 10;
+constexpr uint32_t STRIPE_MAX_HANDSHAKE_ATTEMPT = 5;
+constexpr uint32_t STRIPE_MAX_IDLE_COUNT = 50;
+constexpr unsigned long STRIPE_RECEIVE_TIMEOUT = 200;
+// ûݿɷʱ鹲״̬ļ
+constexpr unsigned long STRIPE_POLL_INTERVAL = 50;
+constexpr double STRIPE_INITIAL_RTO = 500;
+constexpr double STRIPE_MIN_RTO = 20;
+constexpr double STRIPE_MAX_RTO = 5000;
+
+typedef EventLoop::Clock Clock;
+
+struct StripeSegment {
+	uint64_t offset;								// еλ
+	uint16_t length;								// ݳ
+	bool end;										// ǷΪݰ
+	uint32_t retransmit;							// ش
+	Clock::time_point sentAt;						// һη͵ʱ
+};
+
+struct StripeSubflow {
+	const Socket* socket;							// ʹõ׽
+	Socket::Address target;							// ͻ˶Ӧĵַ
+	bool joined;									// ͻǷѾ
+	std::map<uint32_t, StripeSegment> inFlight;		// Ѿ͵ûȷϵݰڵ
+	uint32_t nextSeq;								// һ
+	double congestionWindow;						// Լӵ
+	double smoothedRtt;								// ƽʱ䣬
+	double rttVariance;								// ʱƫ
+	double rto;										// شʱ
+	uint64_t sentCount;								// ͵ݰ
+	uint64_t timeoutCount;							// ʱݰ
+
+	StripeSubflow(const Socket* socket, uint16_t windowSize)
+		: socket(socket), joined(false), nextSeq(0), congestionWindow(std::min<double>(STRIPE_WINDOW_SIZE, windowSize)),
+		smoothedRtt(0), rttVariance(0), rto(STRIPE_INITIAL_RTO), sentCount(0), timeoutCount(0) {}
+
+	bool isWindowAvailable() const {
+		return inFlight.size() < (size_t)congestionWindow;
+	}
+
+	Clock::time_point deadline() const {
+		return inFlight.begin()->second.sentAt + std::chrono::microseconds((long long)(rto * 1000));
+	}
+
+	//  RFC 6298 شʱشݰƣκ ACK ᳷ʱ˱
+	void onAck(const StripeSegment& segment, uint16_t windowSize, Clock::time_point now) {
+		if (segment.retransmit == 0) {
+			double rtt = std::chrono::duration<double, std::milli>(now - segment.sentAt).count();
+			if (smoothedRtt == 0) {
+				smoothedRtt = rtt;
+				rttVariance = rtt / 2;
+			} else {
+				rttVariance = 0.75 * rttVariance + 0.25 * std::abs(smoothedRtt - rtt);
+				smoothedRtt = 0.875 * smoothedRtt + 0.125 * rtt;
+			}
+		}
+		if (smoothedRtt > 0) {
+			rto = std::clamp(smoothedRtt + 4 * rttVariance, STRIPE_MIN_RTO, STRIPE_MAX_RTO);
+		}
+		congestionWindow = std::min<double>(windowSize, congestionWindow + 1.0 / congestionWindow);
+	}
+
+	void onTimeout() {
+		congestionWindow = std::max(1.0, congestionWindow / 2);
+		rto = std::min(rto * 2, STRIPE_MAX_RTO);
+	}
+};
+
+// ķ״̬
+struct StripeStatus {
+	std::vector<StripeSubflow> subflows;
+	std::deque<StripeSegment> retransmitQueue;		// ʱȴ·͵ݰ
+	uint32_t transferId;							// ʱϵĴ
+	uint64_t nextOffset;							// һҪ͵λ
+	uint16_t windowSize;							// Э̺ÿ󴰿
+	uint16_t dataLength;							// Э̺ݰ
+	bool endSent;									// ǷѾ˽ݰ
+	bool confirmed;									// ͻǷѾյֻӦ
+	bool completed;									// ͻǷѾ
+	bool failed;									// ǷΪش
+	size_t active;									// е
+
+	StripeStatus(uint16_t windowSize, uint16_t dataLength)
+		: transferId(0), nextOffset(0), windowSize(windowSize), dataLength(dataLength), endSent(false), confirmed(false),
+		completed(false), failed(false), active(0) {}
+
+	// ·ͳʱݰȻ˳зʣµ
+	bool nextSegment(size_t size, StripeSegment& segment) {
+		if (!retransmitQueue.empty()) {
+			segment = retransmitQueue.front();
+			retransmitQueue.pop_front();
+			return true;
+		}
+		if (endSent) {
+			return false;
+		}
+
+		segment.offset = nextOffset;
+		segment.retransmit = 0;
+		if (nextOffset < size) {
+			segment.length = (uint16_t)std::min<size_t>(dataLength, size - (size_t)nextOffset);
+			segment.end = false;
+			nextOffset += segment.length;
+		} else {
+			segment.length = 0;
+			segment.end = true;
+			endSent = true;
+		}
+		return true;
+	}
+
+	// ͻ˱ʱ󼸸 ACK ʹʧҲҪش
+	bool finished() const {
+		return completed || (endSent && retransmitQueue.empty() && std::all_of(subflows.begin(), subflows.end(),
+			[](const StripeSubflow& subflow) { return subflow.inFlight.empty(); }));
+	}
+};
+
+struct StripeClientStatus {
+	std::vector<std::unique_ptr<Socket>> sockets;	// ׽
+	std::vector<Socket::Address> serverAddresses;	// ĵַ
+	std::vector<double> pathLoss;					// ·ģĶ
+	UdpPacket::Parameters request;					// Ĳ
+	std::string host;								// 
+	StreamReassembly stream;						// Ľջ
+	bool accepted;									// ǷѾյֻӦ
+	bool failed;									// ǷѾʧ
+	size_t active;									// е
+
+	StripeClientStatus() : accepted(false), failed(false), active(0) {}
+};
+
+namespace {
+	int GetSegmentPacket(uint8_t* buffer, const std::string& data, uint32_t seq, uint16_t subflow,
+		const StripeSegment& segment) {
+		if (segment.end) {
+			return UdpPacket::writeStream(buffer, UdpPacket::Type::END, seq, subflow, segment.offset);
+		}
+		return UdpPacket::writeStream(buffer, UdpPacket::Type::DATA, seq, subflow, segment.offset,
+			data.data() + segment.offset, segment.length);
+	}
+
+	std::string ExtraPayload(const uint8_t* buffer, const UdpPacket::Header& header) {
+		if (header.length <= UdpPacket::PARAMETERS_LENGTH) {
+			return std::string();
+		}
+		return std::string((const char*)UdpPacket::data(buffer) + UdpPacket::PARAMETERS_LENGTH,
+			header.length - UdpPacket::PARAMETERS_LENGTH);
+	}
+
+	unsigned long RemainingMilliseconds(Clock::time_point deadline, Clock::time_point now) {
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+		return (unsigned long)std::clamp<long long>(remaining.count(), 1, STRIPE_POLL_INTERVAL);
+	}
+
+	// ʱ䣬ǼеȴЭԶ᷵
+	Task<void> RunSubflow(Task<void> subflow, bool& failed, size_t& active, const char* side, uint16_t index, 
+		StripeProtocol::Logger logger) {
+		try {
+			co_await subflow;
+		} catch (const std::exception& e) {
+			logger(std::format("[{}] Subflow {} failed: {}", side, index, e.what()));
+			failed = true;
+		}
+		--active;
+	}
+
+	// һķͶˣͬһ¼ѭУ״̬Ҫ
+	Task<void> SendSubflow(EventLoop& loop, StripeStatus& status, uint16_t index, const std::string& data,
+		const std::vector<uint8_t>& handshakeAck, StripeProtocol::Logger logger) {
+		StripeSubflow& subflow = status.subflows[index];
+		PacketBuffer buffer = PacketPool::local().acquire();
+		Socket::Address sender;
+		UdpPacket::Header header;
+		StripeSegment segment;
+		Clock::time_point handshakeSentAt = Clock::now();
+		int res = 0;
+
+		while (!status.finished() && !status.failed) {
+			// ȴͻ˴ӶӦ׽ֻּͬһͻˡδ
+			if (!subflow.joined) {
+				res = (co_await loop.receive(*subflow.socket, buffer.get(), STRIPE_BUFFER_LENGTH, sender,
+					STRIPE_POLL_INTERVAL)).length;
+				if (res > 0 && UdpPacket::read(buffer.get(), res, header) && header.type == UdpPacket::Type::HANDSHAKE &&
+					(header.flags & UdpPacket::FLAG_STREAM) && header.stream == index && 
+					header.seq == status.transferId && sender.getIp() == status.subflows[0].target.getIp()) {
+					subflow.joined = true;
+					subflow.target = sender;
+					status.confirmed = true;
+					res = UdpPacket::writeStream(buffer.get(), UdpPacket::Type::HANDSHAKE_ACK, header.seq, index, 0);
+					subflow.socket->send(buffer.get(), res, subflow.target);
+					logger(std::format("[Server] Subflow {} joined from {}:{}", index, sender.getIp(), sender.getPort()));
+				}
+				continue;
+			}
+
+			// ʱݰµȣͨɶ١ڸ
+			Clock::time_point now = Clock::now();
+			bool timeout = false;
+			while (!subflow.inFlight.empty() && subflow.deadline() <= now) {
+				segment = subflow.inFlight.begin()->second;
+				subflow.inFlight.erase(subflow.inFlight.begin());
+				if (++segment.retransmit > STRIPE_MAX_RETRANSMIT) {
+					logger(std::format("[Server] Retransmit failed for {} times, terminating connection",
+						STRIPE_MAX_RETRANSMIT));
+					status.failed = true;
+					break;
+				}
+				status.retransmitQueue.push_back(segment);
+				++subflow.timeoutCount;
+				timeout = true;
+			}
+			if (status.failed) {
+				break;
+			}
+			if (timeout) {
+				subflow.onTimeout();
+				logger(std::format("[Server] Subflow {} timeout, window {:.1f}, rto {:.0f}ms", index,
+					subflow.congestionWindow, subflow.rto));
+			}
+
+			// ͻ˻ûмֻӦѾʧ·
+			if (index == 0 && !status.confirmed &&
+				now - handshakeSentAt >= std::chrono::milliseconds((long long)subflow.rto)) {
+				subflow.socket->send(handshakeAck.data(), (int)handshakeAck.size(), subflow.target);
+				handshakeSentAt = now;
+			}
+
+			// ӵķΧڷ
+			while (subflow.isWindowAvailable() && status.nextSegment(data.size(), segment)) {
+				uint32_t seq = subflow.nextSeq++;
+				segment.sentAt = now;
+				res = GetSegmentPacket(buffer.get(), data, seq, index, segment);
+				subflow.socket->send(buffer.get(), res, subflow.target);
+				subflow.inFlight.emplace(seq, segment);
+				++subflow.sentCount;
+			}
+
+			// ȴ ACKȵ緢͵ݰʱ
+			unsigned long wait = subflow.inFlight.empty() ? STRIPE_POLL_INTERVAL :
+				RemainingMilliseconds(subflow.deadline(), now);
+			res = (co_await loop.receive(*subflow.socket, buffer.get(), STRIPE_BUFFER_LENGTH, sender, wait)).length;
+			while (res > 0) {
+				bool isPacket = UdpPacket::read(buffer.get(), res, header);
+				if (isPacket && header.type == UdpPacket::Type::END) {
+					status.completed = true;
+				} else if (isPacket && header.type == UdpPacket::Type::ACK) {
+					auto acked = subflow.inFlight.find(header.seq);
+					if (acked != subflow.inFlight.end()) {
+						subflow.onAck(acked->second, status.windowSize, Clock::now());
+						subflow.inFlight.erase(acked);
+					}
+				}
+				res = subflow.socket->receive(buffer.get(), STRIPE_BUFFER_LENGTH);
+			}
+		}
+	}
+
+	// һĽնˣһ֣յֻӦټ
+	Task<void> ReceiveSubflow(EventLoop& loop, StripeClientStatus& status, uint16_t index, double ackLoss,
+		std::string name, StripeProtocol::Logger logger) {
+		const Socket& socket = *status.sockets[index];
+		Socket::Address sender, target = status.serverAddresses[index];
+		std::random_device randomDevice;
+		std::default_random_engine engine(randomDevice());
+		std::bernoulli_distribution lossRandom(status.pathLoss[index]), ackLossRandom(ackLoss);
+		PacketBuffer buffer = PacketPool::local().acquire();
+		UdpPacket::Header header;
+		UdpPacket::Parameters accepted;
+		uint32_t handshakeAttempt = 1, idleCount = 0;
+		bool joined = false;
+		int res = 0;
+
+		// طʹͬţݴʶشΪͬһδ俪ʼỰ
+		auto sendHandshake = [&]() {
+			if (index == 0) {
+				res = UdpPacket::writeParameters(buffer.get(), UdpPacket::Type::HANDSHAKE, status.request, 0,
+					name.data(), name.size());
+			} else {
+				res = UdpPacket::writeStream(buffer.get(), UdpPacket::Type::HANDSHAKE, status.request.transferId,
+					index, 0);
+			}
+			socket.send(buffer.get(), res, target);
+		};
+		sendHandshake();
+
+		while (!status.failed) {
+			res = (co_await loop.receive(socket, buffer.get(), STRIPE_BUFFER_LENGTH, sender, 
+				STRIPE_RECEIVE_TIMEOUT)).length;
+			if (res <= 0) {
+				// ɺظشݰֱٷ
+				if (status.stream.finished) {
+					break;
+				}
+				if (!joined) {
+					if (handshakeAttempt >= STRIPE_MAX_HANDSHAKE_ATTEMPT) {
+						logger(index == 0 ? "[Client] Handshake timeout" :
+							std::format("[Client] Subflow {} failed to join", index));
+						status.failed = status.failed || index == 0;
+						break;
+					}
+					++handshakeAttempt;
+					sendHandshake();
+				} else if (++idleCount >= STRIPE_MAX_IDLE_COUNT) {
+					logger(std::format("[Client] Subflow {} timeout", index));
+					status.failed = status.failed || index == 0;
+					break;
+				}
+				continue;
+			}
+			if (!UdpPacket::read(buffer.get(), res, header)) {
+				continue;
+			}
+			idleCount = 0;
+
+			// ֻӦܶʧʱյݰͬʾѾ
+			// Ϊÿδʹõ׽֣֮ Ack ͵ӦԴ
+			if (!joined) {
+				joined = true;
+				target = sender;
+			}
+
+			if (header.type == UdpPacket::Type::HANDSHAKE_ACK) {
+				// ֻӦг˷ĵַӶӦ׽ּ
+				if (index == 0 && !status.accepted && UdpPacket::readParameters(buffer.get(), header, accepted) &&
+					accepted.transferId == status.request.transferId) {
+					std::vector<std::string> lines = util::split(ExtraPayload(buffer.get(), header), "\n");
+					size_t count = std::min<size_t>({ (size_t)accepted.totalLength, status.sockets.size(), lines.size() + 1 });
+
+					// ַϷʱֻӦȴط
+					bool valid = true;
+					for (uint16_t i = 1; i < count; ++i) {
+						std::vector<std::string> parts = util::split(lines[i - 1], " ");
+						unsigned short port = 0;
+						std::from_chars_result parsed = { nullptr, std::errc::invalid_argument };
+						if (parts.size() == 2) {
+							parsed = std::from_chars(parts[1].data(), parts[1].data() + parts[1].size(), port);
+						}
+						if (parsed.ec != std::errc() || parsed.ptr != parts[1].data() + parts[1].size()) {
+							logger(std::format("[Client] Invalid subflow address {}", lines[i - 1]));
+							valid = false;
+							break;
+						}
+
+						// нӿʱʹʱĵַ
+						std::string ip = parts[0] == "0.0.0.0" || parts[0] == "::" ? status.host : parts[0];
+						status.serverAddresses[i] = Socket::Address(ip, port);
+					}
+					if (!valid) {
+						continue;
+					}
+
+					status.accepted = true;
+					logger(std::format("[Client] Transfer {} accepted with {} subflows, window size {}, data length {}",
+						accepted.transferId, count, accepted.windowSize, accepted.dataLength));
+					for (uint16_t i = 1; i < count; ++i) {
+						++status.active;
+						loop.spawn(RunSubflow(ReceiveSubflow(loop, status, i, ackLoss, std::string(), logger),
+							status.failed, status.active, "Client", i, logger));
+					}
+				}
+				continue;
+			}
+			if ((header.type != UdpPacket::Type::DATA && header.type != UdpPacket::Type::END) ||
+				!(header.flags & UdpPacket::FLAG_STREAM)) {
+				continue;
+			}
+			if (lossRandom(engine)) {
+				logger(std::format("[Client] Lost seq {} on subflow {}", header.seq, index));
+				continue;
+			}
+
+			// дͬһظݻᱻ
+			if (status.stream.accept(header, UdpPacket::data(buffer.get(), header))) {
+				logger(std::format("[Client] Transfer finished, length {}", status.stream.data.size()));
+			}
+
+			// ɺýݰ ACKյش
+			// ǷظҪظ ACK
+			if (status.stream.finished) {
+				res = UdpPacket::write(buffer.get(), UdpPacket::Type::END, status.request.transferId);
+				socket.send(buffer.get(), res, target);
+			} else if (ackLossRandom(engine)) {
+				logger(std::format("[Client] Lost ack {} on subflow {}", header.seq, index));
+			} else {
+				res = UdpPacket::write(buffer.get(), UdpPacket::Type::ACK, header.seq);
+				socket.send(buffer.get(), res, target);
+			}
+		}
+	}
+}
+
+StripeProtocol::StripeProtocol(WSAConnection wsaConnection)
+	: logger([](std::string) {}), wsaConnection(wsaConnection),
+	parameters({ UdpPacket::Protocol::STRIPE, STRIPE_WINDOW_SIZE, STRIPE_DATA_LENGTH }) {}
+
+void StripeProtocol::response(const Socket& socket, const Socket::Address& target, const std::string& data) {
+	EventLoop loop;
+	loop.run(responseAsync(loop, socket, target, data));
+}
+
+std::string StripeProtocol::receive(const std::string& host, unsigned short port, const std::string& name,
+	const std::vector<double>& pathLoss, double ackLoss) {
+	EventLoop loop;
+	return loop.run(receiveAsync(loop, host, port, name, pathLoss, ackLoss));
+}
+
+Task<void> StripeProtocol::responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target,
+	const std::string& data) {
+	UdpPacket::Parameters accepted = parameters;
+	accepted.windowSize = std::clamp<uint16_t>(parameters.windowSize, 1, STRIPE_MAX_WINDOW_SIZE);
+	accepted.dataLength = std::clamp<uint16_t>(parameters.dataLength, 1, STRIPE_DATA_LENGTH);
+	accepted.offset = 0;
+	accepted.totalLength = std::clamp<uint64_t>(parameters.totalLength, 1, STRIPE_MAX_SUBFLOWS);
+
+	// һʹûỰ׽֣԰µĶ˿ڣֻӦгǵĵַ
+	std::vector<std::unique_ptr<Socket>> sockets;
+	std::string addresses;
+	std::string defaultHost = socket.getLocalAddress().getIp();
+	for (size_t i = 1; i < accepted.totalLength; ++i) {
+		std::unique_ptr<Socket> subflowSocket = std::make_unique<Socket>(wsaConnection);
+		subflowSocket->init(Socket::ProtocolType::UDP);
+		subflowSocket->bind(localHosts.empty() ? defaultHost : localHosts[i % localHosts.size()], 0);
+		subflowSocket->setBlockMode(false);
+		Socket::Address local = subflowSocket->getLocalAddress();
+		addresses += std::format("{}{} {}", i > 1 ? "\n" : "", local.getIp(), local.getPort());
+		sockets.push_back(std::move(subflowSocket));
+	}
+
+	StripeStatus status(accepted.windowSize, accepted.dataLength);
+	status.transferId = accepted.transferId;
+	status.confirmed = accepted.totalLength == 1;
+	status.subflows.emplace_back(&socket, accepted.windowSize);
+	status.subflows[0].joined = true;
+	status.subflows[0].target = target;
+	for (std::unique_ptr<Socket>& subflowSocket : sockets) {
+		status.subflows.emplace_back(subflowSocket.get(), accepted.windowSize);
+	}
+
+	std::vector<uint8_t> handshakeAck(STRIPE_BUFFER_LENGTH);
+	handshakeAck.resize(UdpPacket::writeParameters(handshakeAck.data(), UdpPacket::Type::HANDSHAKE_ACK, accepted, 0,
+		addresses.data(), addresses.size()));
+	socket.send(handshakeAck.data(), (int)handshakeAck.size(), target);
+	logger(std::format("[Server] Accepted transfer {} with {} subflows, window size {}, data length {}",
+		accepted.transferId, accepted.totalLength, accepted.windowSize, accepted.dataLength));
+
+	status.active = status.subflows.size();
+	for (uint16_t i = 1; i < status.subflows.size(); ++i) {
+		loop.spawn(RunSubflow(SendSubflow(loop, status, i, data, handshakeAck, logger), status.failed, 
+			status.active, "Server", i, logger));
+	}
+	co_await RunSubflow(SendSubflow(loop, status, 0, data, handshakeAck, logger), status.failed, status.active, 
+		"Server", 0, logger);
+	while (status.active > 0) {
+		co_await loop.until([&status]() { return status.active == 0; }, STRIPE_POLL_INTERVAL);
+	}
+
+	for (size_t i = 0; i < status.subflows.size(); ++i) {
+		logger(std::format("[Server] Subflow {} sent {} packets, {} timed out", i, status.subflows[i].sentCount,
+			status.subflows[i].timeoutCount));
+	}
+	logger(status.failed ? "[Server] Test STRIPE protocol failed" : "[Server] Test STRIPE protocol end");
+}
+
+Task<std::string> StripeProtocol::receiveAsync(EventLoop& loop, std::string host, unsigned short port,
+	std::string name, std::vector<double> pathLoss, double ackLoss) {
+	if (pathLoss.empty()) {
+		pathLoss.push_back(0);
+	}
+	if (pathLoss.size() > STRIPE_MAX_SUBFLOWS) {
+		pathLoss.resize(STRIPE_MAX_SUBFLOWS);
+	}
+
+	StripeClientStatus status;
+	status.host = host;
+	status.pathLoss = pathLoss;
+	status.serverAddresses.resize(pathLoss.size());
+	status.serverAddresses[0] = Socket::Address(host, port);
+	for (size_t i = 0; i < pathLoss.size(); ++i) {
+		std::unique_ptr<Socket> socket = std::make_unique<Socket>(wsaConnection);
+		socket->init(Socket::ProtocolType::UDP);
+		if (!localHosts.empty()) {
+			socket->bind(localHosts[i % localHosts.size()], 0);
+		}
+		socket->setBlockMode(false);
+		status.sockets.push_back(std::move(socket));
+	}
+
+	status.request = parameters;
+	status.request.transferId = UdpPacket::newTransferId();
+	status.request.offset = 0;
+	status.request.totalLength = pathLoss.size();
+
+	status.active = 1;
+	co_await RunSubflow(ReceiveSubflow(loop, status, 0, ackLoss, name, logger), status.failed, status.active, 
+		"Client", 0, logger);
+	while (status.active > 0) {
+		co_await loop.until([&status]() { return status.active == 0; }, STRIPE_RECEIVE_TIMEOUT);
+	}
+	co_return status.stream.finished ? std::move(status.stream.data) : std::string();
+}
+
+void StripeProtocol::setLogger(Logger logger) {
+	this->logger = logger;
+}
+
+void StripeProtocol::setParameters(const UdpPacket::Parameters& parameters) {
+	this->parameters = parameters;
+	this->parameters.protocol = UdpPacket::Protocol::STRIPE;
+}
+
+const UdpPacket::Parameters& StripeProtocol::getParameters() const {
+	return this->parameters;
+}
+
+void StripeProtocol::setLocalHosts(const std::vector<std::string>& hosts) {
+	this->localHosts = hosts;
+}
+
+std::string StripeProtocol::parseFileName(const uint8_t* buffer, const UdpPacket::Header& header) {
+	return ExtraPayload(buffer, header);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "UdpReliableProtocol.h"
+#include "EventLoop.h"
+#include <vector>
+
+// Splits one payload across several subflows, each with its own pair of sockets, congestion window and
+// retransmission timer, and reassembles it on the receiver in one shared buffer. Subflows can be bound
+// to different local interfaces. A subflow that loses packets shrinks its window, and segments that time
+// out are rescheduled on whichever subflow has room, so a lossy path carries less of the transfer.
+class StripeProtocol final {
+public:
+	StripeProtocol(WSAConnection wsaConnection);
+
+	typedef UdpReliableProtocol::Logger Logger;
+
+	void response(const Socket& socket, const Socket::Address& target, const std::string& data);
+	std::string receive(const std::string& host, unsigned short port, const std::string& name,
+		const std::vector<double>& pathLoss, double ackLoss);
+
+	// The first subflow uses `socket`; the others get sockets of their own.
+	Task<void> responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, const std::string& data);
+	// Opens one subflow per entry of `pathLoss`, which is the simulated loss rate of that path. An empty
+	// name requests the server's test data.
+	Task<std::string> receiveAsync(EventLoop& loop, std::string host, unsigned short port, std::string name,
+		std::vector<double> pathLoss, double ackLoss);
+
+	void setLogger(Logger logger);
+	void setParameters(const UdpPacket::Parameters& parameters);
+	const UdpPacket::Parameters& getParameters() const;
+	// Local interfaces the subflows are bound to, in turn. By default the server binds every subflow
+	// to the interface of `socket` and the client lets the system choose.
+	void setLocalHosts(const std::vector<std::string>& hosts);
+
+	static std::string parseFileName(const uint8_t* buffer, const UdpPacket::Header& header);
+
+private:
+	Logger logger;
+	WSAConnection wsaConnection;
+	UdpPacket::Parameters parameters;
+	std::vector<std::string> localHosts;
+};
+
@@ -0,0 +1,126 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+template<typename T>
+class Task;
+
+namespace detail {
+	struct TaskPromiseBase {
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+		bool detached = false;
+
+		// Resumes whoever awaited the task; a detached task frees itself instead.
+		struct FinalAwaiter {
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			template<typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+				TaskPromiseBase& promise = handle.promise();
+				if (promise.continuation) {
+					return promise.continuation;
+				}
+				if (promise.detached) {
+					handle.destroy();
+				}
+				return std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept {}
+		};
+
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+
+		FinalAwaiter final_suspend() const noexcept {
+			return {};
+		}
+
+		void unhandled_exception() noexcept {
+			exception = std::current_exception();
+		}
+	};
+
+	template<typename T>
+	struct TaskPromise : TaskPromiseBase {
+		std::optional<T> value;
+
+		void return_value(T result) {
+			value = std::move(result);
+		}
+
+		T result() {
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+			return std::move(*value);
+		}
+	};
+
+	template<>
+	struct TaskPromise<void> : TaskPromiseBase {
+		void return_void() const noexcept {}
+
+		void result() const {
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+		}
+	};
+}
+
+// Lazily started coroutine. Awaiting a task runs it and resumes the awaiter with its result once it
+// finishes; exceptions thrown inside the task are rethrown to the awaiter.
+template<typename T = void>
+class Task final {
+public:
+	struct promise_type : detail::TaskPromise<T> {
+		Task get_return_object() {
+			return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+	};
+
+	Task(const Task&) = delete;
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	~Task() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	Task& operator=(const Task&) = delete;
+	Task& operator=(Task&& other) noexcept {
+		if (this != &other) {
+			if (handle) {
+				handle.destroy();
+			}
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	bool await_ready() const noexcept {
+		return !handle || handle.done();
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+		handle.promise().continuation = awaiter;
+		return handle;
+	}
+
+	T await_resume() {
+		return handle.promise().result();
+	}
+
+private:
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+	friend class EventLoop;
+};
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "sock.h"
+#include "ThreadPlacement.h"
+#include "NulException.h"
+#include <charconv>
+#include <format>
+#include "util.h"
+
+namespace {
+	// Converts a processor number counted across groups into its group and number within the group.
+	bool ToProcessorNumber(unsigned processor, PROCESSOR_NUMBER& number) {
+		WORD groupCount = GetActiveProcessorGroupCount();
+		for (WORD group = 0; group < groupCount; ++group) {
+			DWORD count = GetActiveProcessorCount(group);
+			if (processor < count) {
+				number.Group = group;
+				number.Number = (BYTE)processor;
+				number.Reserved = 0;
+				return true;
+			}
+			processor -= count;
+		}
+		return false;
+	}
+}
+
+bool ThreadPlacement::pin(unsigned processor) {
+	PROCESSOR_NUMBER number;
+	if (!ToProcessorNumber(processor, number)) {
+		return false;
+	}
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = number.Group;
+	affinity.Mask = (KAFFINITY)1 << number.Number;
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+}
+
+int ThreadPlacement::nodeOf(unsigned processor) {
+	PROCESSOR_NUMBER number;
+	USHORT node = 0;
+	if (!ToProcessorNumber(processor, number) || !GetNumaProcessorNodeEx(&number, &node)) {
+		return UNKNOWN_NODE;
+	}
+	return node;
+}
+
+unsigned ThreadPlacement::processorCount() {
+	return GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+std::vector<unsigned> ThreadPlacement::parse(std::string_view list) {
+	std::vector<unsigned> processors;
+	unsigned count = processorCount();
+	auto toNumber = [list, count](std::string_view text) {
+		unsigned value = 0;
+		auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+		if (error != std::errc() || end != text.data() + text.size()) {
+			throw NulException(0, std::format("Invalid processor list {}.", list));
+		}
+		if (value >= count) {
+			throw NulException(0, std::format("Processor {} in {} does not exist, there are {}.", value, list, count));
+		}
+		return value;
+	};
+
+	for (std::string_view part : util::split_view(list, ",")) {
+		part = util::trim_view(part);
+		size_t dash = part.find('-');
+		if (dash == std::string_view::npos) {
+			processors.push_back(toNumber(part));
+			continue;
+		}
+		unsigned first = toNumber(part.substr(0, dash)), last = toNumber(part.substr(dash + 1));
+		if (first > last) {
+			throw NulException(0, std::format("Invalid processor range {} in {}.", part, list));
+		}
+		for (unsigned processor = first; processor <= last; ++processor) {
+			processors.push_back(processor);
+		}
+	}
+	return processors;
+}
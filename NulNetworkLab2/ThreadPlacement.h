@@ -0,0 +1,22 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+// Places threads on processors. Processors are numbered across all processor groups in the order Windows
+// lists them, so the numbers match those shown by Task Manager on machines with more than 64 of them.
+// Memory a thread touches first after being pinned is allocated on the NUMA node of its processor, which
+// is why threads pin themselves first thing, before they allocate anything.
+class ThreadPlacement final {
+public:
+	static constexpr int UNKNOWN_NODE = -1;
+
+	// Restricts the calling thread to `processor`. Returns false when there is no such processor or the
+	// system refused.
+	static bool pin(unsigned processor);
+	// NUMA node of `processor`, or UNKNOWN_NODE.
+	static int nodeOf(unsigned processor);
+	static unsigned processorCount();
+	// Parses a list such as "0,2,4-7". Throws NulException on malformed input, reversed ranges and processors
+	// beyond processorCount().
+	static std::vector<unsigned> parse(std::string_view list);
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <chrono>
+#include <algorithm>
+
+// Token bucket whose rate is kept by the caller, so that the buckets of many peers share one setting and
+// cost a counter and a timestamp each. A bucket that was never used starts full.
+class TokenBucket final {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Rate {
+		double perSecond;						// Zero or less means no limit.
+		double burst;
+	};
+
+	// Takes one token when there is one.
+	bool take(const Rate& rate, Clock::time_point now) {
+		if (!available(rate, now)) {
+			return false;
+		}
+		if (rate.perSecond > 0) {
+			tokens -= 1;
+		}
+		return true;
+	}
+
+	// Whether take() would succeed, without taking the token, so that a caller limited by several buckets
+	// can check all of them before charging any.
+	bool available(const Rate& rate, Clock::time_point now) {
+		if (rate.perSecond <= 0) {
+			return true;
+		}
+		double elapsed = std::chrono::duration<double>(now - updated).count();
+		tokens = std::min(rate.burst, tokens + elapsed * rate.perSecond);
+		updated = now;
+		return tokens >= 1;
+	}
+
+private:
+	double tokens = 0;
+	Clock::time_point updated;
+};
@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "UdpPacket.h"
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <mutex>
+
+// Packet header encoding.
+
+namespace {
+	inline void WriteUint16(uint8_t* buffer, uint16_t value) {
+		buffer[0] = (uint8_t)(value >> 8);
+		buffer[1] = (uint8_t)value;
+	}
+
+	inline void WriteUint32(uint8_t* buffer, uint32_t value) {
+		buffer[0] = (uint8_t)(value >> 24);
+		buffer[1] = (uint8_t)(value >> 16);
+		buffer[2] = (uint8_t)(value >> 8);
+		buffer[3] = (uint8_t)value;
+	}
+
+	inline void WriteUint64(uint8_t* buffer, uint64_t value) {
+		WriteUint32(buffer, (uint32_t)(value >> 32));
+		WriteUint32(&buffer[4], (uint32_t)value);
+	}
+
+	inline uint16_t ReadUint16(const uint8_t* buffer) {
+		return (uint16_t)(((uint16_t)buffer[0] << 8) | buffer[1]);
+	}
+
+	inline uint32_t ReadUint32(const uint8_t* buffer) {
+		return ((uint32_t)buffer[0] << 24) | ((uint32_t)buffer[1] << 16) | ((uint32_t)buffer[2] << 8) | buffer[3];
+	}
+
+	inline uint64_t ReadUint64(const uint8_t* buffer) {
+		return ((uint64_t)ReadUint32(buffer) << 32) | ReadUint32(&buffer[4]);
+	}
+
+}
+
+int UdpPacket::write(uint8_t* buffer, Type type, uint32_t seq, const void* data, size_t length, uint16_t flags) {
+	if (length > MAX_DATA_LENGTH) {
+		length = MAX_DATA_LENGTH;
+	}
+
+	buffer[0] = VERSION;
+	buffer[1] = (uint8_t)type;
+	WriteUint16(&buffer[2], flags);
+	WriteUint32(&buffer[4], seq);
+	WriteUint16(&buffer[8], (uint16_t)length);
+	if (length > 0) {
+		std::memcpy(&buffer[HEADER_LENGTH], data, length);
+	}
+	return (int)(HEADER_LENGTH + length);
+}
+
+int UdpPacket::writeStream(uint8_t* buffer, Type type, uint32_t seq, uint16_t stream, uint64_t offset, 
+	const void* data, size_t length) {
+	if (length > MAX_DATA_LENGTH) {
+		length = MAX_DATA_LENGTH;
+	}
+
+	write(buffer, type, seq, nullptr, 0, FLAG_STREAM);
+	WriteUint16(&buffer[8], (uint16_t)length);
+	WriteUint16(&buffer[HEADER_LENGTH], stream);
+	WriteUint64(&buffer[HEADER_LENGTH + 2], offset);
+	if (length > 0) {
+		std::memcpy(&buffer[HEADER_LENGTH + STREAM_EXTENSION_LENGTH], data, length);
+	}
+	return (int)(HEADER_LENGTH + STREAM_EXTENSION_LENGTH + length);
+}
+
+bool UdpPacket::read(const uint8_t* buffer, int length, Header& header) {
+	if (length < (int)HEADER_LENGTH || buffer[0] != VERSION) {
+		return false;
+	}
+	if (buffer[1] < (uint8_t)Type::HANDSHAKE || buffer[1] > (uint8_t)Type::NAK) {
+		return false;
+	}
+
+	header.type = (Type)buffer[1];
+	header.flags = ReadUint16(&buffer[2]);
+	header.seq = ReadUint32(&buffer[4]);
+	header.length = ReadUint16(&buffer[8]);
+	header.stream = 0;
+	header.offset = 0;
+
+	size_t headerLength = HEADER_LENGTH;
+	if (header.flags & FLAG_STREAM) {
+		if (length < (int)(HEADER_LENGTH + STREAM_EXTENSION_LENGTH)) {
+			return false;
+		}
+		header.stream = ReadUint16(&buffer[HEADER_LENGTH]);
+		header.offset = ReadUint64(&buffer[HEADER_LENGTH + 2]);
+		headerLength += STREAM_EXTENSION_LENGTH;
+	}
+
+	// The declared payload must fit into what was actually received.
+	return header.length <= MAX_DATA_LENGTH && headerLength + header.length <= (size_t)length;
+}
+
+int UdpPacket::writeParameters(uint8_t* buffer, Type type, const Parameters& parameters, uint32_t seq,
+	const void* extra, size_t extraLength) {
+	uint8_t payload[MAX_DATA_LENGTH];
+	payload[0] = (uint8_t)parameters.protocol;
+	WriteUint16(&payload[1], parameters.windowSize);
+	WriteUint16(&payload[3], parameters.dataLength);
+	WriteUint32(&payload[5], parameters.transferId);
+	WriteUint64(&payload[9], parameters.offset);
+	WriteUint64(&payload[17], parameters.totalLength);
+	WriteUint64(&payload[25], parameters.contentVersion);
+
+	// Protocol specific data, such as the stream names of a multiplexed session.
+	extraLength = std::min(extraLength, MAX_DATA_LENGTH - PARAMETERS_LENGTH);
+	if (extraLength > 0) {
+		std::memcpy(&payload[PARAMETERS_LENGTH], extra, extraLength);
+	}
+	return write(buffer, type, seq, payload, PARAMETERS_LENGTH + extraLength);
+}
+
+bool UdpPacket::readParameters(const uint8_t* buffer, const Header& header, Parameters& parameters) {
+	if (header.length < PARAMETERS_LENGTH) {
+		return false;
+	}
+
+	const uint8_t* payload = data(buffer);
+	if (payload[0] < (uint8_t)Protocol::GBN || payload[0] > (uint8_t)Protocol::MULTICAST) {
+		return false;
+	}
+
+	parameters.protocol = (Protocol)payload[0];
+	parameters.windowSize = ReadUint16(&payload[1]);
+	parameters.dataLength = ReadUint16(&payload[3]);
+	parameters.transferId = ReadUint32(&payload[5]);
+	parameters.offset = ReadUint64(&payload[9]);
+	parameters.totalLength = ReadUint64(&payload[17]);
+	parameters.contentVersion = ReadUint64(&payload[25]);
+	return true;
+}
+
+int UdpPacket::writeAck(uint8_t* buffer, uint32_t seq, uint32_t next, uint16_t window) {
+	uint8_t payload[WINDOW_LENGTH];
+	WriteUint32(&payload[0], next);
+	WriteUint16(&payload[4], window);
+	return write(buffer, Type::ACK, seq, payload, WINDOW_LENGTH, FLAG_WINDOW);
+}
+
+bool UdpPacket::readWindow(const uint8_t* buffer, const Header& header, uint32_t& next, uint16_t& window) {
+	if (header.type != Type::ACK || !(header.flags & FLAG_WINDOW) || header.length < WINDOW_LENGTH) {
+		return false;
+	}
+
+	const uint8_t* payload = data(buffer, header);
+	next = ReadUint32(&payload[0]);
+	window = ReadUint16(&payload[4]);
+	return true;
+}
+
+int UdpPacket::writeNak(uint8_t* buffer, uint32_t transferId, const uint32_t* seqs, size_t count) {
+	uint8_t payload[MAX_NAK_COUNT * 4];
+	count = std::min(count, MAX_NAK_COUNT);
+	for (size_t i = 0; i < count; ++i) {
+		WriteUint32(&payload[i * 4], seqs[i]);
+	}
+	return write(buffer, Type::NAK, transferId, payload, count * 4);
+}
+
+bool UdpPacket::readNak(const uint8_t* buffer, const Header& header, std::vector<uint32_t>& seqs) {
+	if (header.type != Type::NAK || header.length % 4 != 0) {
+		return false;
+	}
+
+	const uint8_t* payload = data(buffer, header);
+	seqs.clear();
+	for (size_t i = 0; i < header.length; i += 4) {
+		seqs.push_back(ReadUint32(&payload[i]));
+	}
+	return true;
+}
+
+uint32_t UdpPacket::newTransferId() {
+	static std::random_device randomDevice;
+	static std::mutex randomMutex;
+	std::lock_guard<std::mutex> locked(randomMutex);
+	uint32_t id = 0;
+	while (id == 0) {
+		id = randomDevice();
+	}
+	return id;
+}
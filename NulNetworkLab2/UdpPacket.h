@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Wire format shared by the GBN, SR and multiplexed protocols.
+//
+// Every packet starts with a fixed header in network byte order:
+//   version (1) | type (1) | flags (2) | seq (4) | length (2)
+// followed by exactly `length` bytes of payload. Packets are sent with their
+// real size, so payloads may contain arbitrary binary data.
+//
+// A transfer is opened by the client with a HANDSHAKE carrying the requested
+// parameters; the server replies with HANDSHAKE_ACK carrying the accepted
+// ones, immediately followed by the first window of data. The handshake names
+// the transfer and the byte offset to start from, so an interrupted transfer
+// can be resumed from the last contiguous byte the client holds. The server
+// only resumes when the total length and content version the client learned
+// from an earlier HANDSHAKE_ACK still match its data.
+//
+// Packets with FLAG_STREAM set carry a stream extension right after the
+// header: stream (2) | offset (8). It places the payload inside one of the
+// independent streams of a multiplexed session.
+//
+// ACKs with FLAG_WINDOW set carry the receiver's flow control window as their
+// payload: next (4) | window (2). `next` counts the segments the receiver has
+// delivered in order during this attempt, and the sender may send segments up
+// to, but not including, `next + window`. ACKs without the flag leave the
+// window as it was.
+//
+// A distribution sends one payload to many receivers at once, to a multicast
+// group or to a list of receivers. The sender announces it with HANDSHAKE_ACK
+// parameters whose seq is the number of segments sent so far, and repeats the
+// announcement as a heartbeat. Receivers never acknowledge; they send a NAK to
+// the sender whose payload lists missing segments as seq (4) each. The sender
+// echoes new NAKs to the whole group, so that other receivers missing the same
+// segments hold back their own NAKs.
+//
+// Text commands may also be wrapped in a REQUEST whose seq is a request ID
+// chosen by the client; the server answers with a RESPONSE carrying the same
+// ID, so replies can be matched to requests that are in flight together.
+class UdpPacket final {
+public:
+	enum class Type : uint8_t {
+		HANDSHAKE = 1,
+		HANDSHAKE_ACK,
+		DATA,
+		END,
+		ACK,
+		REQUEST,
+		RESPONSE,
+		NAK
+	};
+
+	enum class Protocol : uint8_t {
+		GBN = 1,
+		SR,
+		MUX,
+		STRIPE,
+		MULTICAST
+	};
+
+	struct Header {
+		Type type;
+		uint16_t flags;
+		uint32_t seq;
+		uint16_t length;
+		uint16_t stream;
+		uint64_t offset;
+	};
+
+	struct Parameters {
+		Protocol protocol;
+		uint16_t windowSize;
+		uint16_t dataLength;
+		uint32_t transferId;
+		uint64_t offset;
+		uint64_t totalLength;
+		uint64_t contentVersion;
+	};
+
+	static constexpr uint8_t VERSION = 1;
+	static constexpr uint16_t FLAG_STREAM = 0x0001;
+	static constexpr uint16_t FLAG_WINDOW = 0x0002;
+	static constexpr size_t HEADER_LENGTH = 10;
+	static constexpr size_t STREAM_EXTENSION_LENGTH = 10;
+	static constexpr size_t PARAMETERS_LENGTH = 33;
+	static constexpr size_t WINDOW_LENGTH = 6;
+	static constexpr size_t MAX_DATA_LENGTH = 1024;
+	static constexpr size_t MAX_LENGTH = HEADER_LENGTH + STREAM_EXTENSION_LENGTH + MAX_DATA_LENGTH;
+	static constexpr size_t MAX_NAK_COUNT = MAX_DATA_LENGTH / 4;
+
+	static int write(uint8_t* buffer, Type type, uint32_t seq, const void* data = nullptr, size_t length = 0,
+		uint16_t flags = 0);
+	static int writeStream(uint8_t* buffer, Type type, uint32_t seq, uint16_t stream, uint64_t offset,
+		const void* data = nullptr, size_t length = 0);
+	static bool read(const uint8_t* buffer, int length, Header& header);
+
+	static int writeParameters(uint8_t* buffer, Type type, const Parameters& parameters, uint32_t seq = 0,
+		const void* extra = nullptr, size_t extraLength = 0);
+	static bool readParameters(const uint8_t* buffer, const Header& header, Parameters& parameters);
+
+	static int writeAck(uint8_t* buffer, uint32_t seq, uint32_t next, uint16_t window);
+	// Returns false when the ACK does not advertise a window.
+	static bool readWindow(const uint8_t* buffer, const Header& header, uint32_t& next, uint16_t& window);
+
+	// Writes at most MAX_NAK_COUNT of `seqs`.
+	static int writeNak(uint8_t* buffer, uint32_t transferId, const uint32_t* seqs, size_t count);
+	static bool readNak(const uint8_t* buffer, const Header& header, std::vector<uint32_t>& seqs);
+
+	// A random, non-zero transfer ID for a new handshake. Safe to call from any thread.
+	static uint32_t newTransferId();
+
+	static uint8_t* data(uint8_t* buffer) {
+		return buffer + HEADER_LENGTH;
+	}
+
+	static const uint8_t* data(const uint8_t* buffer) {
+		return buffer + HEADER_LENGTH;
+	}
+
+	static const uint8_t* data(const uint8_t* buffer, const Header& header) {
+		return buffer + HEADER_LENGTH + ((header.flags & FLAG_STREAM) ? STREAM_EXTENSION_LENGTH : 0);
+	}
+};
@@ -1,13 +1,58 @@
 #include "stdafx.h"
 #include "UdpReliableProtocol.h"
 #include <mutex>
+#include <format>
+#include <algorithm>
+
+constexpr uint32_t UDP_MAX_RESUME_ATTEMPT = 5;
 
 namespace {
 	std::mutex mutex;
 }
 
-UdpReliableProtocol::UdpReliableProtocol(WSAConnection wsaConnection) 
-	: logger([](std::string) {}), wsaConnection(wsaConnection) {}
+UdpReliableProtocol::UdpReliableProtocol(WSAConnection wsaConnection, const UdpPacket::Parameters& parameters) 
+	: logger([](std::string) {}), tracer(nullptr), wsaConnection(wsaConnection), parameters(parameters), transferId(0), attempt(0),
+	totalLength(0), contentVersion(0), completed(false) {}
+
+void UdpReliableProtocol::response(const Socket& socket, const Socket::Address& target, const std::string& data) {
+	EventLoop loop;
+	loop.run(responseAsync(loop, socket, target, data));
+}
+
+std::string UdpReliableProtocol::receive(const std::string& host, unsigned short port, double loss, double ackLoss) {
+	EventLoop loop;
+	return loop.run(receiveAsync(loop, host, port, loss, ackLoss));
+}
+
+bool UdpReliableProtocol::resume(const std::string& host, unsigned short port, double loss, double ackLoss, 
+	std::string& result) {
+	EventLoop loop;
+	return loop.run(resumeAsync(loop, host, port, loss, ackLoss, result));
+}
+
+Task<std::string> UdpReliableProtocol::receiveAsync(EventLoop& loop, std::string host, unsigned short port, 
+	double loss, double ackLoss) {
+	std::string result;
+	transferId = UdpPacket::newTransferId();
+	attempt = 0;
+	totalLength = 0;
+	contentVersion = 0;
+	completed = false;
+	co_await resumeAsync(loop, host, port, loss, ackLoss, result);
+	co_return result;
+}
+
+Task<bool> UdpReliableProtocol::resumeAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+	double ackLoss, std::string& result) {
+	for (uint32_t i = 0; i <= UDP_MAX_RESUME_ATTEMPT && !completed; ++i) {
+		if (i > 0) {
+			logger(std::format("[Client] Transfer {} interrupted, resuming from offset {}", transferId, result.size()));
+		}
+		++attempt;
+		completed = co_await transferAsync(loop, host, port, loss, ackLoss, result);
+	}
+	co_return completed;
+}
 
 void UdpReliableProtocol::setLogger(Logger logger, bool locked) {
 	if (locked) {
@@ -19,3 +64,97 @@ void UdpReliableProtocol::setLogger(Logger logger, bool locked) {
 		this->logger = logger;
 	}
 }
+
+void UdpReliableProtocol::setTracer(PacketTracer* tracer) {
+	this->tracer = tracer;
+}
+
+void UdpReliableProtocol::setBacklog(Backlog backlog) {
+	this->backlog = backlog;
+}
+
+void UdpReliableProtocol::setParameters(const UdpPacket::Parameters& parameters) {
+	UdpPacket::Protocol protocol = this->parameters.protocol;
+	this->parameters = parameters;
+	this->parameters.protocol = protocol;
+}
+
+void UdpReliableProtocol::setContentVersion(uint64_t contentVersion) {
+	this->contentVersion = contentVersion;
+}
+
+const UdpPacket::Parameters& UdpReliableProtocol::getParameters() const {
+	return this->parameters;
+}
+
+uint32_t UdpReliableProtocol::getTransferId() const {
+	return this->transferId;
+}
+
+bool UdpReliableProtocol::isCompleted() const {
+	return this->completed;
+}
+
+void UdpReliableProtocol::sendHandshake(const Socket& socket, const Socket::Address& target, uint8_t* buffer, 
+	uint64_t offset) const {
+	UdpPacket::Parameters request = parameters;
+	request.transferId = transferId;
+	request.offset = offset;
+	request.totalLength = totalLength;
+	request.contentVersion = contentVersion;
+	int length = UdpPacket::writeParameters(buffer, UdpPacket::Type::HANDSHAKE, request, attempt);
+	trace(PacketTracer::Side::CLIENT, PacketTracer::Event::SEND, transferId, attempt, length, UdpPacket::Type::HANDSHAKE);
+	socket.send(buffer, length, target);
+}
+
+bool UdpReliableProtocol::acceptHandshake(const uint8_t* buffer, const UdpPacket::Header& header, std::string& result, 
+	UdpPacket::Parameters& accepted) {
+	if (!UdpPacket::readParameters(buffer, header, accepted) || accepted.transferId != transferId) {
+		return false;
+	}
+
+	// The server restarts from an earlier offset when the data has changed since the last attempt.
+	if (accepted.offset < result.size()) {
+		result.resize((size_t)accepted.offset);
+	}
+	totalLength = accepted.totalLength;
+	contentVersion = accepted.contentVersion;
+	logger(std::format("[Client] Transfer {} accepted at offset {} of {}, window size {}, data length {}", 
+		transferId, accepted.offset, accepted.totalLength, accepted.windowSize, accepted.dataLength));
+	return true;
+}
+
+bool UdpReliableProtocol::recordHandshake(const uint8_t* buffer, const UdpPacket::Header& header) {
+	UdpPacket::Parameters accepted;
+	if (!UdpPacket::readParameters(buffer, header, accepted) || accepted.transferId != transferId) {
+		return false;
+	}
+	totalLength = accepted.totalLength;
+	contentVersion = accepted.contentVersion;
+	return true;
+}
+
+UdpPacket::Parameters UdpReliableProtocol::negotiate(uint16_t maxWindowSize, uint16_t maxDataLength, 
+	size_t dataSize) const {
+	UdpPacket::Parameters accepted = parameters;
+	accepted.windowSize = std::clamp<uint16_t>(parameters.windowSize, 1, maxWindowSize);
+	accepted.dataLength = std::clamp<uint16_t>(parameters.dataLength, 1, maxDataLength);
+	accepted.totalLength = dataSize;
+	accepted.contentVersion = contentVersion;
+
+	// Only resume when the client is looking at the same data.
+	if (parameters.totalLength != dataSize || parameters.contentVersion != contentVersion || 
+		parameters.offset > dataSize) {
+		accepted.offset = 0;
+	}
+	return accepted;
+}
+
+uint16_t UdpReliableProtocol::receiveWindow(uint16_t capacity) const {
+	if (!backlog) {
+		return capacity;
+	}
+	size_t dataLength = std::max<size_t>(parameters.dataLength, 1);
+	size_t pending = (backlog() + dataLength - 1) / dataLength;
+	return (uint16_t)(capacity - std::min<size_t>(pending, capacity));
+}
@@ -1,20 +1,78 @@
 #pragma once
 #include "Socket.h"
+#include "UdpPacket.h"
+#include "EventLoop.h"
+#include "PacketTracer.h"
 
 class UdpReliableProtocol {
 public:
-	UdpReliableProtocol(WSAConnection wsaConnection);
+	UdpReliableProtocol(WSAConnection wsaConnection, const UdpPacket::Parameters& parameters);
 	virtual ~UdpReliableProtocol() = default;
 
 	typedef std::function<void(std::string)> Logger;
+	// Bytes the client has delivered that the application has not consumed yet.
+	typedef std::function<size_t()> Backlog;
 
-	virtual void response(const Socket& socket, const Socket::Address& target, const std::string& data) = 0;
-	virtual std::string receive(const std::string& host, unsigned short port, double loss, double ackLoss) = 0;
+	// Blocking calls run the asynchronous versions on a private event loop. The asynchronous versions
+	// must run on `loop`, and `socket`, `data` and `result` must stay alive until they finish.
+	void response(const Socket& socket, const Socket::Address& target, const std::string& data);
+	std::string receive(const std::string& host, unsigned short port, double loss, double ackLoss);
+	bool resume(const std::string& host, unsigned short port, double loss, double ackLoss, std::string& result);
+
+	virtual Task<void> responseAsync(EventLoop& loop, const Socket& socket, Socket::Address target, 
+		const std::string& data) = 0;
+	Task<std::string> receiveAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+		double ackLoss);
+	Task<bool> resumeAsync(EventLoop& loop, std::string host, unsigned short port, double loss, double ackLoss, 
+		std::string& result);
 
 	void setLogger(Logger logger, bool locked = false);
+	// Records every packet sent and received by this transfer; `tracer` must outlive it. Null disables tracing.
+	void setTracer(PacketTracer* tracer);
+	// The backlog counts against the window the client advertises, so a slow consumer slows the server down
+	// instead of having its data dropped and sent again. Without one the window is always fully open.
+	void setBacklog(Backlog backlog);
+	void setParameters(const UdpPacket::Parameters& parameters);
+	// Version of the data the server sends, such as a hash of its modification time. Clients remember it
+	// from the handshake and the server only lets them resume data of the same version.
+	void setContentVersion(uint64_t contentVersion);
+	const UdpPacket::Parameters& getParameters() const;
+	uint32_t getTransferId() const;
+	bool isCompleted() const;
 
 protected:
+	// Runs one attempt of the current transfer, appending to `result` from its current size.
+	// Returns true once the end of the data has been delivered.
+	virtual Task<bool> transferAsync(EventLoop& loop, std::string host, unsigned short port, double loss, 
+		double ackLoss, std::string& result) = 0;
+
+	void sendHandshake(const Socket& socket, const Socket::Address& target, uint8_t* buffer, uint64_t offset) const;
+	// Reads the server's answer into `accepted`, the window and data length both sides agreed on.
+	bool acceptHandshake(const uint8_t* buffer, const UdpPacket::Header& header, std::string& result, 
+		UdpPacket::Parameters& accepted);
+	// Records the length and version of the data from a HANDSHAKE_ACK that arrived after the first data,
+	// so that the transfer can still be resumed if it is interrupted.
+	bool recordHandshake(const uint8_t* buffer, const UdpPacket::Header& header);
+	UdpPacket::Parameters negotiate(uint16_t maxWindowSize, uint16_t maxDataLength, size_t dataSize) const;
+	// Segments the client can take past the ones it has delivered in order, out of `capacity`.
+	uint16_t receiveWindow(uint16_t capacity) const;
+
+	void trace(PacketTracer::Side side, PacketTracer::Event event, uint32_t session, uint32_t seq, size_t size, 
+		UdpPacket::Type type) const {
+		if (tracer != nullptr) {
+			tracer->record(side, event, session, seq, size, type);
+		}
+	}
+
 	Logger logger;
+	Backlog backlog;
+	PacketTracer* tracer;
 	WSAConnection wsaConnection;
+	UdpPacket::Parameters parameters;
+	uint32_t transferId;
+	uint32_t attempt;
+	uint64_t totalLength;
+	uint64_t contentVersion;
+	bool completed;
 };
 
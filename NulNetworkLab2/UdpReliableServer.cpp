@@ -1,62 +1,293 @@
 #include "stdafx.h"
 #include "UdpReliableServer.h"
 #include <memory>
-#include <thread>
 #include <mutex>
 #include <cstdint>
-#include <map>
+#include <algorithm>
 #include <random>
-#include <fstream>
+#include <string_view>
+#include <charconv>
+#include <format>
 #include "util.h"
 #include "NulNetworkException.h"
 #include "GbnProtocol.h"
 #include "SrProtocol.h"
+#include "MuxProtocol.h"
+#include "StripeProtocol.h"
+#include "MulticastProtocol.h"
+#include "UdpPacket.h"
+#include "CommandTable.h"
+#include "ThreadPlacement.h"
+#include "PeerTable.h"
 
-constexpr int BUFFER_LENGTH = 1026;
+constexpr int BUFFER_LENGTH = (int)UdpPacket::MAX_LENGTH;
+// ÿͻ˵ַֻס֣ʶشͬһַĶͻҲЩ¼
+constexpr size_t PEER_RECENT_HANDSHAKE = 8;
+constexpr size_t SERVER_PEER_MEMORY_LIMIT = 64 * 1024 * 1024;
+constexpr unsigned long SERVER_PEER_IDLE_TIMEOUT = 60 * 1000;
+// ÿͻ˺ƣÿͻ
+constexpr TokenBucket::Rate SERVER_PEER_REQUEST_RATE = { 1000, 200 };
+constexpr TokenBucket::Rate SERVER_PEER_TRANSFER_RATE = { 2, 8 };
+constexpr TokenBucket::Rate SERVER_REQUEST_RATE = { 100000, 10000 };
+constexpr TokenBucket::Rate SERVER_TRANSFER_RATE = { 100, 200 };
+constexpr std::chrono::seconds RATE_LIMIT_REPORT_INTERVAL(1);
+constexpr unsigned long LISTEN_TIMEOUT = 500;
+constexpr size_t SERVER_LOOP_COUNT = 1;
+// 󲿷ʱ䶼ڵȴΪѭÿһѭ
+constexpr size_t SERVER_WORKER_COUNT = 0;
+constexpr size_t SERVER_MAX_SESSIONS = 256;
+// ͻطʱ䣬ʱ仹ûпʼĴͻѾ
+constexpr std::chrono::milliseconds SERVER_HANDSHAKE_TIMEOUT(5000);
+constexpr std::chrono::seconds SERVER_SESSION_IDLE_TIMEOUT(60);
+constexpr size_t SERVER_CONTENT_CACHE_CAPACITY = 64 * 1024 * 1024;
+constexpr const char* TEST_DATA_PATH = "test.txt";
+// 鲥ַྭ·
+constexpr unsigned long DISTRIBUTION_HOPS = 8;
 
 namespace {
 	std::mutex mutex;
 
-	std::string ReadTestData() {
-		std::ifstream ifs("test.txt");
-		std::string result;
-		int c;
-		while ((c = ifs.get()) != EOF) {
-			result += (char)c;
-		}
-		return result;
-	}
-
-	const std::map<std::string, std::function<std::string(const Socket&, const Socket::Address&,
-		UdpReliableServer::Logger)>> serverInstructionMap = {
-		{"-time", [](const Socket&, const Socket::Address&, UdpReliableServer::Logger) {
-			return util::get_local_time_string("%Y.%m.%d %H:%M:%S");
-		}},
-		{"-quit", [](const Socket&, const Socket::Address&, UdpReliableServer::Logger) {
-			return "Good bye!";
-		}},
-		{"-testgbn", [](const Socket& socket, const Socket::Address& target, UdpReliableServer::Logger logger) {
-			GbnProtocol gbn(socket.getWsaConnection());
-			gbn.setLogger(logger);
-			gbn.response(socket, target, ReadTestData());
-			return std::string();
-		}},
-		{"-testsr", [](const Socket& socket, const Socket::Address& target, UdpReliableServer::Logger logger) {
-			SrProtocol sr(socket.getWsaConnection());
-			sr.setLogger(logger);
-			sr.response(socket, target, ReadTestData());
-			return std::string();
-		}}
+	// ֻȡǰĿ¼µͨļֹͻ˷Ŀ¼
+	bool IsValidFileName(const std::string& name) {
+		return !name.empty() && name[0] != '.' && name.find_first_of("/\\:") == std::string::npos;
+	}
+
+	// ûļʱʹòݣļϷʱõյ
+	std::shared_ptr<const Content> ReadContent(ContentCache& contents, const std::string& name) {
+		if (name.empty()) {
+			return contents.get(TEST_DATA_PATH);
+		}
+		return contents.get(IsValidFileName(name) ? name : std::string());
+	}
+
+	std::unique_ptr<UdpReliableProtocol> CreateProtocol(UdpPacket::Protocol protocol, WSAConnection wsaConnection) {
+		switch (protocol) {
+		case UdpPacket::Protocol::GBN:
+			return std::make_unique<GbnProtocol>(wsaConnection);
+		case UdpPacket::Protocol::SR:
+			return std::make_unique<SrProtocol>(wsaConnection);
+		}
+		throw NulNetworkException(0, "Invalid protocol type.");
+	}
+
+	// ͻ˵󣬰Ĳʼ
+	Task<void> ResponseTransfer(EventLoop& loop, const Socket& socket, Socket::Address target, 
+		UdpPacket::Parameters parameters, UdpReliableServer::Logger logger, PacketTracer* tracer, ContentCache& contents) {
+		std::unique_ptr<UdpReliableProtocol> protocol = CreateProtocol(parameters.protocol, socket.getWsaConnection());
+		// ڼһֱлеݣʹ̭Ҳͷ
+		std::shared_ptr<const Content> content = ReadContent(contents, std::string());
+		protocol->setLogger(logger);
+		protocol->setTracer(tracer);
+		protocol->setParameters(parameters);
+		protocol->setContentVersion(content->version());
+		co_await protocol->responseAsync(loop, socket, target, content->data);
+	}
+
+	// ·õЯ˸Ӧļ
+	Task<void> ResponseStreams(EventLoop& loop, const Socket& socket, Socket::Address target, 
+		std::vector<std::string> names, UdpPacket::Parameters parameters, UdpReliableServer::Logger logger,
+		ContentCache& contents) {
+		// ֱûеݣڼһֱ
+		std::vector<std::shared_ptr<const Content>> held;
+		std::vector<std::string_view> streams;
+		for (const std::string& name : names) {
+			if (IsValidFileName(name)) {
+				held.push_back(ReadContent(contents, name));
+				streams.push_back(held.back()->data);
+			} else {
+				streams.push_back(std::string_view());
+			}
+		}
+
+		MuxProtocol protocol(socket.getWsaConnection());
+		protocol.setLogger(logger);
+		protocol.setParameters(parameters);
+		co_await protocol.responseAsync(loop, socket, target, streams);
+	}
+
+	// Яļûļʱ
+	Task<void> ResponseStripes(EventLoop& loop, const Socket& socket, Socket::Address target, std::string name,
+		std::vector<std::string> hosts, UdpPacket::Parameters parameters, UdpReliableServer::Logger logger,
+		ContentCache& contents) {
+		std::shared_ptr<const Content> content = ReadContent(contents, name);
+
+		StripeProtocol protocol(socket.getWsaConnection());
+		protocol.setLogger(logger);
+		protocol.setParameters(parameters);
+		protocol.setLocalHosts(hosts);
+		co_await protocol.responseAsync(loop, socket, target, content->data);
+	}
+
+	typedef std::function<Task<void>(EventLoop&, const Socket&, const Socket::Address&)> SessionHandler;
+
+	std::string DescribeException(std::exception_ptr exception) {
+		try {
+			std::rethrow_exception(exception);
+		} catch (const std::exception& e) {
+			return e.what();
+		} catch (...) {
+			return "unknown error";
+		}
+	}
+
+	// ʹõ׽һδ䣬ʱ黹ռõĻỰ
+	Task<void> RunSession(EventLoop& loop, WSAConnection wsaConnection, std::string host, Socket::Address target, 
+		UdpReliableServer::Logger logger, SessionHandler handler, std::atomic<size_t>& active, 
+		EventLoop::Clock::time_point accepted) {
+		// ѭæʱܺſʼʱͻѾ
+		if (EventLoop::Clock::now() - accepted > SERVER_HANDSHAKE_TIMEOUT) {
+			logger(std::format("[Server] Transfer to {}:{} started too late, dropped", target.getIp(), target.getPort()));
+		} else {
+			try {
+				Socket socket(wsaConnection);
+				socket.init(Socket::ProtocolType::UDP);
+				socket.bind(host, 0);
+				socket.setBlockMode(false);
+				co_await handler(loop, socket, target);
+			} catch (const std::exception& e) {
+				logger(std::format("[Server] Session failed: {}", e.what()));
+			}
+		}
+		--active;
+	}
+
+	// ΪڹѭУָѭҲռ߳
+	// ͬʱеĴﵽʱ false
+	bool StartSession(EventLoopPool& workers, std::atomic<size_t>& active, WSAConnection wsaConnection, 
+		const std::string& host, const Socket::Address& target, UdpReliableServer::Logger logger, SessionHandler handler) {
+		if (++active > SERVER_MAX_SESSIONS) {
+			--active;
+			return false;
+		}
+		EventLoop& loop = workers.next();
+		loop.spawn(RunSession(loop, wsaConnection, host, target, logger, std::move(handler), active, 
+			EventLoop::Clock::now()));
+		return true;
+	}
+
+	// ͻ˵״̬ư IP ַ棬˿ڣһ˿ڷͲƹ
+	// ͬһ NAT ֮Ŀͻ˹һ
+	Socket::Address::Key PeerKey(const Socket::Address& address) {
+		Socket::Address::Key key = address.key();
+		key.port = 0;
+		return key;
+	}
+
+	// ÿͻ˵ַ״̬ڻỰУʱûݵĿͻ˻ᱻƳ
+	struct PeerState {
+		uint64_t recentHandshakes[PEER_RECENT_HANDSHAKE] = {};
+		uint8_t usedHandshakes = 0;					// ÿһλʾӦļ¼ǷЧ
+		uint8_t nextHandshake = 0;
+		TokenBucket requests;
+		TokenBucket transfers;
 	};
+
+	// ͬһΪشεֻһ
+	bool IsDuplicateHandshake(const PeerState& peer, uint32_t transferId, uint32_t attempt) {
+		uint64_t key = ((uint64_t)transferId << 32) | attempt;
+		for (size_t i = 0; i < PEER_RECENT_HANDSHAKE; ++i) {
+			if ((peer.usedHandshakes >> i & 1) != 0 && peer.recentHandshakes[i] == key) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// ֻ¼Ѿʼֲ֣ܾἷЩ¼ͻطʱ³
+	void RememberHandshake(PeerState& peer, uint32_t transferId, uint32_t attempt) {
+		peer.recentHandshakes[peer.nextHandshake] = ((uint64_t)transferId << 32) | attempt;
+		peer.usedHandshakes |= (uint8_t)(1 << peer.nextHandshake);
+		peer.nextHandshake = (uint8_t)((peer.nextHandshake + 1) % PEER_RECENT_HANDSHAKE);
+	}
+
+	struct CommandContext {
+		const Socket& socket;
+		const Socket::Address& sender;
+		const UdpReliableServer::Logger& logger;
+		PacketTracer* tracer;
+		ContentCache& contents;
+		std::string_view arguments;
+	};
+
+	// ֱָӰѽдظҲԿʼһڹѭϽеĴ䣻Чʱش
+	struct ServerCommand {
+		size_t (*reply)(const CommandContext& context, char* buffer, size_t length);
+		SessionHandler (*session)(const CommandContext& context);
+	};
+
+	typedef CommandTable<ServerCommand, 4> ServerCommandTable;
+
+	size_t CopyReply(std::string_view reply, char* buffer, size_t length) {
+		size_t size = std::min(reply.size(), length);
+		std::memcpy(buffer, reply.data(), size);
+		return size;
+	}
+
+	// ָĲʽΪ [ڴС] [ݳ]ʡԵĲʹЭĬֵ
+	// һΧڵ֣򲻿ʼ
+	bool ParseTransferArguments(UdpPacket::Parameters& parameters, std::string_view arguments) {
+		for (uint16_t* field : { &parameters.windowSize, &parameters.dataLength }) {
+			ServerCommandTable::CommandLine line = ServerCommandTable::parse(arguments);
+			if (line.name.empty()) {
+				break;
+			}
+			const char* end = line.name.data() + line.name.size();
+			auto [parsed, error] = std::from_chars(line.name.data(), end, *field);
+			if (error != std::errc() || parsed != end) {
+				return false;
+			}
+			arguments = line.arguments;
+		}
+		return true;
+	}
+
+	constexpr ServerCommandTable serverCommands({
+		{"-time", {[](const CommandContext&, char* buffer, size_t length) -> size_t {
+			static thread_local util::time_formatter formatter("%Y.%m.%d %H:%M:%S", 0);
+			return formatter.format(buffer, length);
+		}, nullptr}},
+		{"-quit", {[](const CommandContext&, char* buffer, size_t length) -> size_t {
+			return CopyReply("Good bye!", buffer, length);
+		}, nullptr}},
+		{"-testgbn", {nullptr, [](const CommandContext& context) -> SessionHandler {
+			GbnProtocol gbn(context.socket.getWsaConnection());
+			UdpPacket::Parameters parameters = gbn.getParameters();
+			if (!ParseTransferArguments(parameters, context.arguments)) {
+				return nullptr;
+			}
+			UdpReliableServer::Logger logger = context.logger;
+			return [parameters, logger, tracer = context.tracer, contents = &context.contents](EventLoop& loop, 
+				const Socket& socket, const Socket::Address& target) {
+				return ResponseTransfer(loop, socket, target, parameters, logger, tracer, *contents);
+			};
+		}}},
+		{"-testsr", {nullptr, [](const CommandContext& context) -> SessionHandler {
+			SrProtocol sr(context.socket.getWsaConnection());
+			UdpPacket::Parameters parameters = sr.getParameters();
+			if (!ParseTransferArguments(parameters, context.arguments)) {
+				return nullptr;
+			}
+			UdpReliableServer::Logger logger = context.logger;
+			return [parameters, logger, tracer = context.tracer, contents = &context.contents](EventLoop& loop, 
+				const Socket& socket, const Socket::Address& target) {
+				return ResponseTransfer(loop, socket, target, parameters, logger, tracer, *contents);
+			};
+		}}}
+	});
 }
 
 UdpReliableServer::UdpReliableServer(WSAConnection wsaConnection) 
-	: wsaConnection(wsaConnection), socket(wsaConnection), logger([](std::string) {}), serverStarted(false) {}
+	: wsaConnection(wsaConnection), socket(wsaConnection), logger([](std::string) {}), serverStarted(false), 
+	tracer(nullptr), peerMemoryLimit(SERVER_PEER_MEMORY_LIMIT), peerIdleTimeout(SERVER_PEER_IDLE_TIMEOUT), 
+	peerRequestRate(SERVER_PEER_REQUEST_RATE), peerTransferRate(SERVER_PEER_TRANSFER_RATE), 
+	requestRate(SERVER_REQUEST_RATE), transferRate(SERVER_TRANSFER_RATE), busyPoll(0), 
+	contents(SERVER_CONTENT_CACHE_CAPACITY), activeSessions(0) {}
 
 void UdpReliableServer::init(const std::string& host, unsigned short port) {
 	socket.init(Socket::ProtocolType::UDP);
 	socket.bind(host, port);
 	socket.setBlockMode(false);
+	this->host = host;
 }
 
 void UdpReliableServer::start() {
@@ -65,35 +296,12 @@ void UdpReliableServer::start() {
 	}
 
 	serverStarted = true;
+	if (!loops) {
+		place();
+	}
 
-	std::thread serverThread = std::thread([this]() {
-		std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(BUFFER_LENGTH);
-		Socket::Address sender;
-		while (serverStarted) {
-			// ָ˿
-			int res = socket.receive(buffer.get(), BUFFER_LENGTH, sender);
-			if (res < 0) {
-				continue;
-			}
-
-			// ָִг
-			std::string instruction = util::trim(std::string(reinterpret_cast<const char*>(buffer.get()), res));
-			std::string result;
-
-			if (serverInstructionMap.contains(instruction)) {
-				result = serverInstructionMap.at(instruction)(socket, sender, logger);
-			} else {
-				result = instruction;
-			}
-
-			// ڱеֱָӷ
-			if (!result.empty()) {
-				socket.send(result, sender);
-			}
-		}
-	});
-
-	serverThread.detach();
+	EventLoop& loop = loops->next();
+	loop.spawn(listen(loop));
 }
 
 void UdpReliableServer::close() {
@@ -118,22 +326,109 @@ std::string UdpReliableServer::sendTestRequest(const std::string& host, unsigned
 	}
 
 	protocol->setLogger(logger);
+	protocol->setTracer(tracer);
 	return protocol->receive(host, port, loss, ackLoss);
 }
 
-std::string UdpReliableServer::send(const std::string& host, unsigned short port, const std::string& message) const {
+std::vector<std::string> UdpReliableServer::sendStreamRequest(const std::string& host, unsigned short port, 
+	const std::vector<std::string>& names, double loss, double ackLoss) const {
+	MuxProtocol protocol(wsaConnection);
+	protocol.setLogger(logger);
+	return protocol.receive(host, port, names, loss, ackLoss);
+}
+
+std::string UdpReliableServer::sendStripeRequest(const std::string& host, unsigned short port, const std::string& name,
+	const std::vector<double>& pathLoss, double ackLoss) const {
+	StripeProtocol protocol(wsaConnection);
+	protocol.setLogger(logger);
+	return protocol.receive(host, port, name, pathLoss, ackLoss);
+}
+
+void UdpReliableServer::distribute(const std::string& name, const std::vector<Socket::Address>& targets) const {
+	if (!name.empty() && !IsValidFileName(name)) {
+		throw NulNetworkException(0, "Invalid file name.");
+	}
+	std::shared_ptr<const Content> content = ReadContent(contents, name);
+
+	// ַʹõ׽֣շ NAK ѭ
 	Socket socket(wsaConnection);
-	Socket::Address target(host, port);
-	std::unique_ptr<char[]> buffer = std::make_unique<char[]>(BUFFER_LENGTH);
 	socket.init(Socket::ProtocolType::UDP);
-	socket.send(message, target);
-	int length = socket.receive(buffer.get(), BUFFER_LENGTH, target);
+	socket.bind(host.empty() ? "0.0.0.0" : host, 0);
+	if (std::any_of(targets.begin(), targets.end(), [](const Socket::Address& target) { return target.isMulticast(); })) {
+		socket.setMulticast(DISTRIBUTION_HOPS, true);
+	}
+	socket.setBlockMode(false);
 
+	MulticastProtocol protocol(wsaConnection);
+	protocol.setLogger(logger);
+	protocol.response(socket, targets, content->data);
+}
+
+std::string UdpReliableServer::receiveDistribution(const std::string& group, unsigned short port, double loss) const {
+	MulticastProtocol protocol(wsaConnection);
+	protocol.setLogger(logger);
+	return protocol.receive(group, port, loss);
+}
+
+std::string UdpReliableServer::send(const std::string& host, unsigned short port, const std::string& message) const {
+	EventLoop loop;
+	return loop.run(sendAsync(loop, host, port, message));
+}
+
+Task<std::string> UdpReliableServer::sendAsync(EventLoop& loop, std::string host, unsigned short port, 
+	std::string message) const {
+	CommandSession& session = acquireSession(loop, Socket::Address(host, port));
 	std::string result;
-	if (length > 0) {
-		result.append(buffer.get(), length);
+	try {
+		result = co_await session.requestAsync(loop, std::move(message));
+	} catch (...) {
+		releaseSession(session);
+		throw;
+	}
+	releaseSession(session);
+	co_return result;
+}
+
+// ͬһĿĻỰڿʱԱѭʹãæµʱֻܱʹѭʹ
+CommandSession& UdpReliableServer::acquireSession(EventLoop& loop, const Socket::Address& target) const {
+	std::lock_guard<std::mutex> locked(sessionsMutex);
+	// ʱûʹõĻỰر׽ֲƳỰŷʹĿһֱ
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::erase_if(sessions, [now](const auto& entry) {
+		return entry.second.users == 0 && now - entry.second.idleSince >= SERVER_SESSION_IDLE_TIMEOUT;
+	});
+	auto range = sessions.equal_range(target);
+	for (auto it = range.first; it != range.second; ++it) {
+		PooledSession& pooled = it->second;
+		if (pooled.users == 0 || pooled.loop == &loop) {
+			pooled.loop = &loop;
+			++pooled.users;
+			return *pooled.session;
+		}
+	}
+	auto it = sessions.emplace(target, PooledSession{ std::make_unique<CommandSession>(wsaConnection, target), &loop, 1, 
+		now });
+	return *it->second.session;
+}
+
+void UdpReliableServer::releaseSession(CommandSession& session) const {
+	std::lock_guard<std::mutex> locked(sessionsMutex);
+	auto range = sessions.equal_range(session.getTarget());
+	auto released = std::find_if(range.first, range.second, [&session](const auto& entry) {
+		return entry.second.session.get() == &session;
+	});
+	if (released == range.second || --released->second.users > 0) {
+		return;
+	}
+	// ͬһĿֻһеĻỰ
+	bool idleKept = std::any_of(range.first, range.second, [released](const auto& entry) {
+		return &entry != &*released && entry.second.users == 0;
+	});
+	if (idleKept) {
+		sessions.erase(released);
+	} else {
+		released->second.idleSince = std::chrono::steady_clock::now();
 	}
-	return result;
 }
 
 void UdpReliableServer::setLogger(Logger logger) {
@@ -143,7 +438,231 @@ void UdpReliableServer::setLogger(Logger logger) {
 	};
 }
 
+void UdpReliableServer::setTracer(PacketTracer* tracer) {
+	this->tracer = tracer;
+}
+
+void UdpReliableServer::setSubflowHosts(const std::vector<std::string>& hosts) {
+	this->subflowHosts = hosts;
+}
+
+void UdpReliableServer::setBusyPoll(unsigned long microseconds) {
+	busyPoll = microseconds;
+	if (loops) {
+		loops->setBusyPoll(microseconds);
+		workers->setBusyPoll(microseconds);
+	}
+}
 
+void UdpReliableServer::setAffinity(const std::vector<unsigned>& receiveProcessors, 
+	const std::vector<unsigned>& workerProcessors) {
+	this->receiveProcessors = receiveProcessors;
+	this->workerProcessors = workerProcessors;
+}
 
+// ѭ͹̣߳߳ڴ¼ѭ֮ǰȰ󶨴֮ڴ涼ڶӦ NUMA ڵ
+void UdpReliableServer::place() {
+	loops = std::make_unique<EventLoopPool>(SERVER_LOOP_COUNT, receiveProcessors);
+	workers = std::make_unique<EventLoopPool>(SERVER_WORKER_COUNT, workerProcessors);
 
+	// ѭӳ쳣ֻ¼ѭϢؽ
+	EventLoop::ExceptionHandler handler = [this](std::exception_ptr exception) {
+		logger(std::format("[Server] Task failed: {}", DescribeException(exception)));
+	};
+	loops->setExceptionHandler(handler);
+	workers->setExceptionHandler(handler);
+	loops->setBusyPoll(busyPoll);
+	workers->setBusyPoll(busyPoll);
 
+	auto report = [this](const char* role, const EventLoopPool& pool, const std::vector<unsigned>& processors) {
+		if (processors.empty()) {
+			logger(std::format("[Server] No processors set for {} threads", role));
+			return;
+		}
+		for (size_t index = 0; index < pool.size(); ++index) {
+			unsigned processor = processors[index % processors.size()];
+			if (!pool.isPinned(index)) {
+				logger(std::format("[Server] Failed to pin {} thread {} to processor {}", role, index, processor));
+				continue;
+			}
+			int node = ThreadPlacement::nodeOf(processor);
+			logger(std::format("[Server] Pinned {} thread {} to processor {}, node {}", role, index, processor,
+				node == ThreadPlacement::UNKNOWN_NODE ? std::string("unknown") : std::to_string(node)));
+		}
+	};
+	report("receive", *loops, receiveProcessors);
+	report("worker", *workers, workerProcessors);
+}
+
+void UdpReliableServer::setContentCacheCapacity(size_t bytes) {
+	contents.setCapacity(bytes);
+}
+
+void UdpReliableServer::setPeerLimits(size_t memoryLimit, unsigned long idleTimeout) {
+	peerMemoryLimit = memoryLimit;
+	peerIdleTimeout = idleTimeout;
+}
+
+void UdpReliableServer::setPeerRateLimits(TokenBucket::Rate requests, TokenBucket::Rate transfers) {
+	peerRequestRate = requests;
+	peerTransferRate = transfers;
+}
+
+void UdpReliableServer::setServerRateLimits(TokenBucket::Rate requests, TokenBucket::Rate transfers) {
+	requestRate = requests;
+	transferRate = transfers;
+}
+
+Task<void> UdpReliableServer::listen(EventLoop& loop) {
+	std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(BUFFER_LENGTH);
+	std::unique_ptr<char[]> reply = std::make_unique<char[]>(BUFFER_LENGTH);
+	Socket::Address sender;
+	UdpPacket::Header header;
+	UdpPacket::Parameters parameters;
+	std::unique_ptr<uint8_t[]> packet = std::make_unique<uint8_t[]>(BUFFER_LENGTH);
+	PeerTable<PeerState> peers(peerMemoryLimit, std::chrono::milliseconds(peerIdleTimeout));
+	logger(std::format("[Server] Peer table holds up to {} peers, idle timeout {} ms", peers.getCapacity(), 
+		peerIdleTimeout));
+	TokenBucket requestBucket, transferBucket;
+	// Ựʱû״̬Ŀͻ˹һͻ˵
+	TokenBucket unknownPeerBucket;
+	size_t limitedRequests = 0, limitedTransfers = 0;
+	TokenBucket::Clock::time_point lastLimitReport = TokenBucket::Clock::now();
+	// ͬʱܵͻ˺ƣ߶ʱͬʱ۳
+	auto admitTransfer = [&](PeerState& peer, TokenBucket::Clock::time_point now) {
+		if (peer.transfers.available(peerTransferRate, now) && transferBucket.available(transferRate, now)) {
+			peer.transfers.take(peerTransferRate, now);
+			transferBucket.take(transferRate, now);
+			return true;
+		}
+		++limitedTransfers;
+		return false;
+	};
+	while (serverStarted) {
+		// ȴָ˿ڵݣʱ¼ǷѾر
+		int res = (co_await loop.receive(socket, buffer.get(), BUFFER_LENGTH, sender, LISTEN_TIMEOUT)).length;
+		TokenBucket::Clock::time_point now = TokenBucket::Clock::now();
+		// Ƶֻڻܼ¼ⷺʱ־Ϊ
+		if (now - lastLimitReport >= RATE_LIMIT_REPORT_INTERVAL) {
+			if (limitedRequests > 0 || limitedTransfers > 0) {
+				logger(std::format("[Server] Rate limited {} requests and {} transfers", limitedRequests, 
+					limitedTransfers));
+			}
+			limitedRequests = limitedTransfers = 0;
+			lastLimitReport = now;
+		}
+		if (res < 0) {
+			peers.expire(now);
+			continue;
+		}
+
+		// Ƶݰڽ֮ǰֱӶظֻ÷
+		// ȼƣݰڻỰռλû򼷵ͻ
+		if (!requestBucket.take(requestRate, now)) {
+			++limitedRequests;
+			continue;
+		}
+
+		// ỰûпƳĿпͻʱµĿͻֻܵõæĻظ
+		PeerState* peer = peers.acquire(PeerKey(sender), now);
+		TokenBucket& peerRequests = peer != nullptr ? peer->requests : unknownPeerBucket;
+		if (!peerRequests.take(peerRequestRate, now)) {
+			++limitedRequests;
+			continue;
+		}
+
+		// ֱЯ˴
+		bool isPacket = UdpPacket::read(buffer.get(), res, header);
+		if (isPacket && header.type == UdpPacket::Type::HANDSHAKE) {
+			if (peer == nullptr) {
+				logger(std::format("[Server] Too many peers, handshake from {}:{} dropped", sender.getIp(), 
+					sender.getPort()));
+			} else if (UdpPacket::readParameters(buffer.get(), header, parameters) &&
+				!IsDuplicateHandshake(*peer, parameters.transferId, header.seq)) {
+				// ʱ֣ͻطʱٳ
+				if (!admitTransfer(*peer, now)) {
+					continue;
+				}
+
+				SessionHandler handler;
+				if (parameters.protocol == UdpPacket::Protocol::MUX) {
+					handler = [names = MuxProtocol::parseStreamNames(buffer.get(), header), parameters, logger = logger,
+						contents = &contents](EventLoop& loop, const Socket& socket, const Socket::Address& target) {
+						return ResponseStreams(loop, socket, target, names, parameters, logger, *contents);
+					};
+				} else if (parameters.protocol == UdpPacket::Protocol::STRIPE) {
+					handler = [name = StripeProtocol::parseFileName(buffer.get(), header), hosts = subflowHosts, 
+						parameters, logger = logger, contents = &contents](EventLoop& loop, const Socket& socket, 
+						const Socket::Address& target) {
+						return ResponseStripes(loop, socket, target, name, hosts, parameters, logger, *contents);
+					};
+				} else {
+					handler = [parameters, logger = logger, tracer = tracer.load(), contents = &contents](EventLoop& loop, 
+						const Socket& socket, const Socket::Address& target) {
+						return ResponseTransfer(loop, socket, target, parameters, logger, tracer, *contents);
+					};
+				}
+
+				// ͬʱеĴ̫ʱ֣ͻطʱٳ
+				if (StartSession(*workers, activeSessions, wsaConnection, host, sender, logger, handler)) {
+					RememberHandshake(*peer, parameters.transferId, header.seq);
+				} else {
+					logger(std::format("[Server] Too many transfers, handshake of transfer {} dropped", 
+						parameters.transferId));
+				}
+			}
+			continue;
+		}
+
+		// ָִгָͲֱýջ
+		// ŵָǻظڻظдͬıţͻ˾ݴƥظԶʧ
+		bool isRequest = isPacket && header.type == UdpPacket::Type::REQUEST;
+		std::string_view instruction(reinterpret_cast<const char*>(buffer.get()), res);
+		if (isRequest) {
+			instruction = std::string_view(reinterpret_cast<const char*>(UdpPacket::data(buffer.get())), header.length);
+		}
+		// ظʧܣԴַ޷ֻӰһ󣬲ܽѭ
+		auto respond = [&](const char* data, size_t length) {
+			try {
+				if (isRequest) {
+					int packetLength = UdpPacket::write(packet.get(), UdpPacket::Type::RESPONSE, header.seq, data, length);
+					socket.send(packet.get(), packetLength, sender);
+				} else if (length > 0) {
+					socket.send(data, (int)length, sender);
+				}
+			} catch (const NulNetworkException& e) {
+				logger(std::format("[Server] Failed to reply to {}:{}: {}", sender.getIp(), sender.getPort(), e.what()));
+			}
+		};
+		if (peer == nullptr) {
+			respond(reply.get(), CopyReply("Server busy, please try again later.", reply.get(), BUFFER_LENGTH));
+			continue;
+		}
+
+		ServerCommandTable::CommandLine line = ServerCommandTable::parse(instruction);
+		const ServerCommand* command = serverCommands.find(line.name);
+		CommandContext context = { socket, sender, logger, tracer, contents, line.arguments };
+
+		if (command == nullptr) {
+			// ڱеֱָӷ
+			instruction = util::trim_view(instruction);
+			respond(instruction.data(), instruction.size());
+		} else if (command->reply != nullptr) {
+			respond(reply.get(), command->reply(context, reply.get(), BUFFER_LENGTH));
+		} else if (isRequest) {
+			// Եظʼ䣬ָֻͨ
+			respond(reply.get(), CopyReply("Transfers cannot be requested over a command session.", reply.get(), 
+				BUFFER_LENGTH));
+		} else {
+			// ЧĴռô
+			SessionHandler handler = command->session(context);
+			if (!handler) {
+				respond(reply.get(), CopyReply("Invalid arguments, expected [window size] [data length].", 
+					reply.get(), BUFFER_LENGTH));
+			} else if (!admitTransfer(*peer, now) || 
+				!StartSession(*workers, activeSessions, wsaConnection, host, sender, logger, std::move(handler))) {
+				respond(reply.get(), CopyReply("Server busy, please try again later.", reply.get(), BUFFER_LENGTH));
+			}
+		}
+	}
+}
@@ -1,8 +1,17 @@
 #pragma once
 #include "Socket.h"
+#include "EventLoop.h"
+#include "CommandSession.h"
+#include "PacketTracer.h"
+#include "ContentCache.h"
+#include "TokenBucket.h"
 #include <functional>
 #include <string>
 #include <atomic>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
 
 class UdpReliableServer final {
 public:
@@ -21,14 +30,89 @@ public:
 
 	std::string sendTestRequest(const std::string& host, unsigned short port, ProtocolType protocolType, 
 		double loss = 0.2, double ackLoss = 0.2) const;
+	std::vector<std::string> sendStreamRequest(const std::string& host, unsigned short port, 
+		const std::vector<std::string>& names, double loss = 0.2, double ackLoss = 0.2) const;
+	// Stripes one transfer over a subflow per entry of `pathLoss`, the simulated loss rate of each path.
+	std::string sendStripeRequest(const std::string& host, unsigned short port, const std::string& name,
+		const std::vector<double>& pathLoss, double ackLoss = 0.2) const;
+	// Sends the file `name`, or the test data when it is empty, to every receiver at once. `targets` is a
+	// multicast group or a list of receivers; each lost segment is resent once for all of them, and the
+	// call returns once the receivers stop asking for repairs.
+	void distribute(const std::string& name, const std::vector<Socket::Address>& targets) const;
+	// Waits on `port` for one distribution, joining `group` when it is a multicast address.
+	std::string receiveDistribution(const std::string& group, unsigned short port, double loss = 0.2) const;
+	// Commands to the same server share a pooled session, so send() costs no socket setup or lookup and
+	// concurrent sendAsync() calls on one loop are pipelined over it.
 	std::string send(const std::string& host, unsigned short port, const std::string& message) const;
+	Task<std::string> sendAsync(EventLoop& loop, std::string host, unsigned short port, std::string message) const;
 
 	void setLogger(Logger logger);
+	// Traces GBN and SR transfers started after the call, on both sides; `tracer` must outlive the server.
+	// Null turns tracing off again.
+	void setTracer(PacketTracer* tracer);
+	// Local interfaces the extra subflows of striped transfers are bound to; by default the listening host.
+	// Must be set before start().
+	void setSubflowHosts(const std::vector<std::string>& hosts);
+	// Opt-in busy polling for the command loop and transfer sessions, in microseconds; zero disables it.
+	// Applies from start() on when set before it.
+	void setBusyPoll(unsigned long microseconds);
+	// Processors the receive loops and the transfer workers are pinned to, the i-th thread of each to entry
+	// i modulo its list; an empty list leaves those threads to the scheduler. The threads are only created
+	// by start() and pin themselves before creating their loop, so that their buffers and session state
+	// are allocated on the NUMA node of their processor. Must be set before start(), which reports where
+	// every thread was placed.
+	void setAffinity(const std::vector<unsigned>& receiveProcessors, const std::vector<unsigned>& workerProcessors);
+	// Upper bound on the file contents kept in memory between transfers, in bytes; zero disables caching.
+	void setContentCacheCapacity(size_t bytes);
+	// Memory the per-peer state of the receive loop may take, in bytes, and how long a peer that sends
+	// nothing keeps its state, in milliseconds. When the table is full the longest idle peer is evicted,
+	// and peers are turned away while all of them are active. Must be set before start().
+	void setPeerLimits(size_t memoryLimit, unsigned long idleTimeout);
+	// Token bucket limits on the packets and the new transfers each peer may send, and on those of all
+	// peers together. Packets over their limit are dropped as soon as they are received, before any
+	// parsing; transfers over theirs get a busy reply, or are dropped when they come as handshakes, which
+	// the client resends. Peers are told apart by IP address alone, so clients sharing an address, such
+	// as those behind one NAT or on the local host, share one limit. Must be set before start().
+	void setPeerRateLimits(TokenBucket::Rate requests, TokenBucket::Rate transfers);
+	void setServerRateLimits(TokenBucket::Rate requests, TokenBucket::Rate transfers);
 
 private:
+	struct PooledSession {
+		std::unique_ptr<CommandSession> session;
+		EventLoop* loop;
+		size_t users;
+		std::chrono::steady_clock::time_point idleSince;
+	};
+
+	Task<void> listen(EventLoop& loop);
+	void place();
+	CommandSession& acquireSession(EventLoop& loop, const Socket::Address& target) const;
+	void releaseSession(CommandSession& session) const;
+
 	WSAConnection wsaConnection;
 	Socket socket;
 	Logger logger;
 	std::atomic_bool serverStarted;
+	std::atomic<PacketTracer*> tracer;
+	std::string host;
+	std::vector<std::string> subflowHosts;
+	std::vector<unsigned> receiveProcessors;
+	std::vector<unsigned> workerProcessors;
+	size_t peerMemoryLimit;
+	unsigned long peerIdleTimeout;
+	TokenBucket::Rate peerRequestRate;
+	TokenBucket::Rate peerTransferRate;
+	TokenBucket::Rate requestRate;
+	TokenBucket::Rate transferRate;
+	unsigned long busyPoll;
+	// Declared before the workers so that it outlives the sessions reading from it.
+	mutable ContentCache contents;
+	// Declared before the workers, whose sessions give their slot back when they finish.
+	std::atomic<size_t> activeSessions;
+	// Both pools are created by start(), so that objects only used to send requests start no threads.
+	std::unique_ptr<EventLoopPool> workers;
+	mutable std::mutex sessionsMutex;
+	mutable std::unordered_multimap<Socket::Address, PooledSession> sessions;
+	std::unique_ptr<EventLoopPool> loops;
 };
 
@@ -5,6 +5,11 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 
+// Keep std::min and std::max usable.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
 #include <WinSock2.h>
 #include <WS2tcpip.h>
 #include <Windows.h>
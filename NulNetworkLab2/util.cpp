@@ -3,147 +3,317 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <cctype>
-#include <sstream>
-#include <iomanip>
+#include <bit>
+#include <cstring>
+#include "util.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTIL_AVX2
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTIL_SSE2
+#endif
 
 // Util methods.
 
 namespace util {
 
-	std::string trim(const std::string& val) {
-		if (val.empty()) {
-			return std::string();
+	namespace {
+		bool is_space(char c) {
+			return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
 		}
 
-		size_t left = 0, right = val.size() - 1;
-		for (; left < val.size(); ++left) {
-			if (!isspace(val[left])) {
-				break;
-			}
+#if defined(UTIL_AVX2)
+		constexpr size_t BLOCK_SIZE = 32;
+		constexpr uint32_t BLOCK_MASK = 0xffffffffu;
+
+		// Bit i is set when byte i of the block is whitespace.
+		uint32_t space_mask(const char* block) {
+			__m256i c = _mm256_loadu_si256((const __m256i*)block);
+			__m256i control = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+			control = _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8('\r' - '\t')), control);
+			return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(control, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '))));
 		}
-		for (; right > 0; --right) {
-			if (!isspace(val[right])) {
-				break;
-			}
+
+		uint32_t byte_mask(const char* block, char value) {
+			__m256i c = _mm256_loadu_si256((const __m256i*)block);
+			return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(value)));
 		}
-		std::string result = val.substr(left, right - left + 1);
-		return result;
-	}
+#elif defined(UTIL_SSE2)
+		constexpr size_t BLOCK_SIZE = 16;
+		constexpr uint32_t BLOCK_MASK = 0xffffu;
 
-	std::string trim_left(const std::string& val) {
-		if (val.empty()) {
-			return std::string();
+		// Bit i is set when byte i of the block is whitespace.
+		uint32_t space_mask(const char* block) {
+			__m128i c = _mm_loadu_si128((const __m128i*)block);
+			__m128i control = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+			control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8('\r' - '\t')), control);
+			return (uint32_t)_mm_movemask_epi8(_mm_or_si128(control, _mm_cmpeq_epi8(c, _mm_set1_epi8(' '))));
 		}
 
-		size_t left = 0;
-		for (; left < val.size(); ++left) {
-			if (!isspace(val[left])) {
-				break;
+		uint32_t byte_mask(const char* block, char value) {
+			__m128i c = _mm_loadu_si128((const __m128i*)block);
+			return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(value)));
+		}
+#endif
+
+		// Index of the first non-whitespace character, or `length`.
+		size_t skip_spaces(const char* data, size_t length) {
+			size_t i = 0;
+#if defined(UTIL_AVX2) || defined(UTIL_SSE2)
+			for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE) {
+				uint32_t mask = ~space_mask(data + i) & BLOCK_MASK;
+				if (mask != 0) {
+					return i + std::countr_zero(mask);
+				}
 			}
+#endif
+			while (i < length && is_space(data[i])) {
+				++i;
+			}
+			return i;
 		}
 
-		if (left == val.size()) {
-			return std::string();
+		// Length left after dropping trailing whitespace.
+		size_t skip_spaces_back(const char* data, size_t length) {
+			size_t i = length;
+#if defined(UTIL_AVX2) || defined(UTIL_SSE2)
+			for (; i >= BLOCK_SIZE; i -= BLOCK_SIZE) {
+				uint32_t mask = ~space_mask(data + i - BLOCK_SIZE) & BLOCK_MASK;
+				if (mask != 0) {
+					return i - BLOCK_SIZE + std::bit_width(mask);
+				}
+			}
+#endif
+			while (i > 0 && is_space(data[i - 1])) {
+				--i;
+			}
+			return i;
 		}
 
-		std::string result = val.substr(left, val.size() - left);
-		return result;
+		size_t find_byte(const char* data, size_t length, char value) {
+			size_t i = 0;
+#if defined(UTIL_AVX2) || defined(UTIL_SSE2)
+			for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE) {
+				uint32_t mask = byte_mask(data + i, value);
+				if (mask != 0) {
+					return i + std::countr_zero(mask);
+				}
+			}
+#endif
+			for (; i < length; ++i) {
+				if (data[i] == value) {
+					return i;
+				}
+			}
+			return std::string_view::npos;
+		}
 	}
 
-	std::string trim_right(const std::string& val) {
-		if (val.empty()) {
-			return std::string();
+	std::string_view trim_view(std::string_view val) {
+		return trim_right_view(trim_left_view(val));
+	}
+
+	std::string_view trim_left_view(std::string_view val) {
+		return val.substr(skip_spaces(val.data(), val.size()));
+	}
+
+	std::string_view trim_right_view(std::string_view val) {
+		return val.substr(0, skip_spaces_back(val.data(), val.size()));
+	}
+
+	size_t find_space(std::string_view val) {
+		size_t i = 0;
+#if defined(UTIL_AVX2) || defined(UTIL_SSE2)
+		for (; i + BLOCK_SIZE <= val.size(); i += BLOCK_SIZE) {
+			uint32_t mask = space_mask(val.data() + i);
+			if (mask != 0) {
+				return i + std::countr_zero(mask);
+			}
 		}
+#endif
+		for (; i < val.size(); ++i) {
+			if (is_space(val[i])) {
+				return i;
+			}
+		}
+		return std::string_view::npos;
+	}
 
-		size_t right = val.size() - 1;
-		for (; right > 0; --right) {
-			if (!isspace(val[right])) {
+	size_t find(std::string_view val, std::string_view pattern) {
+		if (pattern.empty()) {
+			return 0;
+		}
+
+		// Look for the first byte of the pattern with the vector scan, then compare the rest.
+		size_t start = 0;
+		while (start + pattern.size() <= val.size()) {
+			size_t pos = find_byte(val.data() + start, val.size() - start - pattern.size() + 1, pattern[0]);
+			if (pos == std::string_view::npos) {
 				break;
 			}
+			pos += start;
+			if (std::memcmp(val.data() + pos + 1, pattern.data() + 1, pattern.size() - 1) == 0) {
+				return pos;
+			}
+			start = pos + 1;
 		}
+		return std::string_view::npos;
+	}
+
+	split_view::iterator::iterator(std::string_view val, std::string_view splitor) 
+		: rest(val), splitor(splitor), part(), last(false), done(false) {
+		++*this;
+	}
 
-		if (right == 0) {
-			if (isspace(val[0])) {
-				return std::string();
+	split_view::iterator& split_view::iterator::operator++() {
+		if (splitor.empty()) {
+			done = rest.empty();
+			if (!done) {
+				part = rest.substr(0, 1);
+				rest.remove_prefix(1);
 			}
+			return *this;
+		}
+		if (last) {
+			done = true;
+			return *this;
 		}
+		size_t pos = find(rest, splitor);
+		if (pos == std::string_view::npos) {
+			part = rest;
+			last = true;
+		} else {
+			part = rest.substr(0, pos);
+			rest.remove_prefix(pos + splitor.size());
+		}
+		return *this;
+	}
 
-		std::string result = val.substr(0, right + 1);
-		return result;
+	std::string trim(const std::string& val) {
+		return std::string(trim_view(val));
+	}
+
+	std::string trim_left(const std::string& val) {
+		return std::string(trim_left_view(val));
+	}
+
+	std::string trim_right(const std::string& val) {
+		return std::string(trim_right_view(val));
 	}
 
 	std::vector<std::string> split(const std::string& val, const std::string& splitor) {
 		std::vector<std::string> result;
+		for (std::string_view part : split_view(val, splitor)) {
+			result.emplace_back(part);
+		}
+		return result;
+	}
 
-		if (splitor.empty()) {
-			for (const char c : val) {
-				result.push_back(std::string(1, c));
-			}
-		} else {
-			size_t prev = 0, pos = 0;
-			while (true) {
-				pos = val.find(splitor, prev);
-				if (pos == std::string::npos) {
-					result.push_back(val.substr(prev, val.size() - prev));
-					break;
-				} else {
-					result.push_back(val.substr(prev, pos - prev));
-				}
-				prev = pos + splitor.size();
-			}
+	namespace {
+		// strftime into a stack buffer; long enough for any timestamp format in use.
+		std::string format_tm(const std::tm& time, const std::string& format) {
+			char buffer[256];
+			size_t length = std::strftime(buffer, sizeof(buffer), format.c_str(), &time);
+			return std::string(buffer, length);
 		}
 
-		return result;
+		constexpr uint32_t FRACTION_DIVISORS[] = { 1000000, 100000, 10000, 1000, 100, 10, 1 };
 	}
 
 	std::string get_time_string(const std::tm& time, const std::string& format) {
-		std::stringstream ss;
-		ss << std::put_time(&time, format.c_str());
-		std::string result = ss.str();
-		return result;
+		return format_tm(time, format);
 	}
 
-
 	std::string get_local_time_string(const std::time_t time, const std::string& format) {
-		std::stringstream ss;
 		std::tm t;
 		localtime_s(&t, &time);
-		ss << std::put_time(&t, format.c_str());
-		std::string result = ss.str();
-		return result;
+		return format_tm(t, format);
 	}
 
 	std::string get_local_time_string(const std::string& format) {
-		std::time_t time = std::time(NULL);
-		std::stringstream ss;
-		std::tm t;
-		localtime_s(&t, &time);
-		ss << std::put_time(&t, format.c_str());
-		std::string result = ss.str();
-		return result;
+		return get_local_time_string(std::time(NULL), format);
 	}
 
 	std::string get_gmt_time_string(const std::time_t time, const std::string& format) {
-		std::stringstream ss;
 		std::tm t;
 		gmtime_s(&t, &time);
-		ss << std::put_time(&t, format.c_str());
-		std::string result = ss.str();
-		return result;
+		return format_tm(t, format);
 	}
 
 	std::string get_gmt_time_string(const std::string& format) {
-		std::time_t time = std::time(NULL);
-		std::stringstream ss;
-		std::tm t;
-		gmtime_s(&t, &time);
-		ss << std::put_time(&t, format.c_str());
-		std::string result = ss.str();
-		return result;
+		return get_gmt_time_string(std::time(NULL), format);
 	}
 
 	void sleep(unsigned long millseconds) {
 		Sleep(millseconds);
 	}
+
+	uint64_t monotonic_ns() {
+		static const int64_t frequency = [] {
+			LARGE_INTEGER value;
+			QueryPerformanceFrequency(&value);
+			return value.QuadPart;
+		}();
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+
+		// The counter runs at 10 MHz on current systems, which converts without a division.
+		if (frequency == 10000000) {
+			return (uint64_t)counter.QuadPart * 100;
+		}
+		return (uint64_t)(counter.QuadPart / frequency * 1000000000 + counter.QuadPart % frequency * 1000000000 / frequency);
+	}
+
+	time_formatter::time_formatter(const std::string& format, int digits, bool local)
+		: pattern(format), digits(std::clamp(digits, 0, 6)), local(local), cached_second(INT64_MIN), 
+		prefix_length(0), prefix() {}
+
+	size_t time_formatter::format(char* buffer, size_t length) {
+		return format(std::chrono::system_clock::now(), buffer, length);
+	}
+
+	size_t time_formatter::format(std::chrono::system_clock::time_point time, char* buffer, size_t length) {
+		int64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+		int64_t second = microseconds / 1000000;
+		int64_t fraction = microseconds % 1000000;
+		if (fraction < 0) {
+			--second;
+			fraction += 1000000;
+		}
+
+		if (second != cached_second) {
+			std::time_t now = (std::time_t)second;
+			std::tm t;
+			if (local) {
+				localtime_s(&t, &now);
+			} else {
+				gmtime_s(&t, &now);
+			}
+			prefix_length = std::strftime(prefix, sizeof(prefix), pattern.c_str(), &t);
+			cached_second = second;
+		}
+
+		size_t total = prefix_length + (digits > 0 ? (size_t)digits + 1 : 0);
+		if (total > length) {
+			return 0;
+		}
+		std::memcpy(buffer, prefix, prefix_length);
+		if (digits > 0) {
+			char* digit = buffer + prefix_length;
+			*digit = '.';
+			uint32_t value = (uint32_t)fraction / FRACTION_DIVISORS[digits];
+			for (int i = digits; i > 0; --i) {
+				digit[i] = (char)('0' + value % 10);
+				value /= 10;
+			}
+		}
+		return total;
+	}
+
+	size_t format_local_time(char* buffer, size_t length) {
+		static thread_local time_formatter formatter;
+		return formatter.format(buffer, length);
+	}
 }
\ No newline at end of file
@@ -1,10 +1,87 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
+#include <iterator>
 #include <ctime>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
 
 namespace util {
 
+	// Whitespace is the set matched by isspace in the C locale. The view variants return parts of their
+	// argument and never allocate; they scan with SSE2 or AVX2 when the target has it.
+	std::string_view trim_view(std::string_view val);
+
+	std::string_view trim_left_view(std::string_view val);
+
+	std::string_view trim_right_view(std::string_view val);
+
+	// Position of the first whitespace character, or npos.
+	size_t find_space(std::string_view val);
+
+	// Position of the first occurrence of `pattern`, or npos.
+	size_t find(std::string_view val, std::string_view pattern);
+
+	// Lazily iterates the parts of `val` between occurrences of `splitor`, as views into `val`. Yields the
+	// same parts as split(): separators at either end or next to each other give empty parts, and an empty
+	// splitor gives one part per character.
+	class split_view final {
+	public:
+		class iterator final {
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef std::string_view value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const std::string_view* pointer;
+			typedef const std::string_view& reference;
+
+			iterator() = default;
+			iterator(std::string_view val, std::string_view splitor);
+
+			reference operator*() const {
+				return part;
+			}
+			pointer operator->() const {
+				return &part;
+			}
+			iterator& operator++();
+			iterator operator++(int) {
+				iterator previous = *this;
+				++*this;
+				return previous;
+			}
+
+			bool operator==(const iterator& other) const {
+				return done == other.done && (done || part.data() == other.part.data());
+			}
+			bool operator==(std::default_sentinel_t) const {
+				return done;
+			}
+
+		private:
+			std::string_view rest = {};
+			std::string_view splitor = {};
+			std::string_view part = {};
+			bool last = false;
+			bool done = true;
+		};
+
+		split_view(std::string_view val, std::string_view splitor) : val(val), splitor(splitor) {}
+
+		iterator begin() const {
+			return iterator(val, splitor);
+		}
+		std::default_sentinel_t end() const {
+			return std::default_sentinel;
+		}
+
+	private:
+		std::string_view val;
+		std::string_view splitor;
+	};
+
 	std::string trim(const std::string& val);
 
 	std::string trim_left(const std::string& val);
@@ -25,4 +102,31 @@ namespace util {
 
 	void sleep(unsigned long millseconds);
 
+	// Monotonic time in nanoseconds, for protocol timing. Unrelated to the wall clock.
+	uint64_t monotonic_ns();
+
+	// Formats wall-clock timestamps such as "2023.10.19 07:24:16.123" into caller buffers without
+	// allocating. The part of the format down to the second is run through strftime once per second and
+	// cached; calls within the same second copy it and write only the `digits` sub-second digits (0 to 6).
+	// Not thread-safe; use one formatter per thread, or format_local_time().
+	class time_formatter final {
+	public:
+		time_formatter(const std::string& format = "%Y.%m.%d %H:%M:%S", int digits = 3, bool local = true);
+
+		// Writes the timestamp without a terminating zero and returns its length, or 0 if it does not fit.
+		size_t format(char* buffer, size_t length);
+		size_t format(std::chrono::system_clock::time_point time, char* buffer, size_t length);
+
+	private:
+		std::string pattern;
+		int digits;
+		bool local;
+		int64_t cached_second;
+		size_t prefix_length;
+		char prefix[64];
+	};
+
+	// Formats the current local time with millisecond digits through a formatter owned by the calling thread.
+	size_t format_local_time(char* buffer, size_t length);
+
 }
\ No newline at end of file
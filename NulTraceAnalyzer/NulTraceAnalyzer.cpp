@@ -0,0 +1,272 @@
+#include "PacketTracer.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <format>
+#include <cstring>
+#include <stdexcept>
+
+// Reads the trace files written by PacketTracer and reports, for every transfer, the RTT samples taken
+// from first transmissions and their ACKs, and the cause of every retransmission. With -csv it also
+// writes one row per event, ready to be plotted as sequence number against time. Traces of the server
+// and of the client of the same transfers can be given together; both sides must have run on the same
+// machine for their timestamps to be comparable.
+
+typedef PacketTracer::Record Record;
+typedef PacketTracer::Event Event;
+typedef PacketTracer::Side Side;
+
+namespace {
+	enum class Cause {
+		DATA_LOST,			// The receiver dropped the data.
+		ACK_LOST,			// The receiver took the data but its ACK was dropped.
+		OUT_OF_ORDER,		// The receiver got the data but did not acknowledge it, as GBN does after a gap.
+		SPURIOUS,			// The receiver acknowledged the data; the timer expired before the ACK was used.
+		NOT_RECEIVED,		// The receiver never saw the data, so it was lost in the network.
+		UNKNOWN,			// There is no trace of the receiver.
+		COUNT
+	};
+
+	constexpr const char* CAUSE_NAMES[] = { "data lost", "ack lost", "discarded out of order", "spurious timeout",
+		"lost in network", "unknown, no client trace" };
+
+	struct SessionReport {
+		size_t events[6] = {};
+		std::vector<double> rtts;
+		size_t causes[(size_t)Cause::COUNT] = {};
+	};
+
+	const char* EventName(Event event) {
+		switch (event) {
+		case Event::SEND: return "send";
+		case Event::RETRANSMIT: return "retransmit";
+		case Event::RECEIVE: return "receive";
+		case Event::DROP: return "drop";
+		case Event::TIMEOUT: return "timeout";
+		}
+		return "unknown";
+	}
+
+	const char* TypeName(UdpPacket::Type type) {
+		switch (type) {
+		case UdpPacket::Type::HANDSHAKE: return "handshake";
+		case UdpPacket::Type::HANDSHAKE_ACK: return "handshake_ack";
+		case UdpPacket::Type::DATA: return "data";
+		case UdpPacket::Type::END: return "end";
+		case UdpPacket::Type::ACK: return "ack";
+		case UdpPacket::Type::REQUEST: return "request";
+		case UdpPacket::Type::RESPONSE: return "response";
+		case UdpPacket::Type::NAK: return "nak";
+		}
+		return "unknown";
+	}
+
+	bool IsData(const Record& record) {
+		return record.type == UdpPacket::Type::DATA || record.type == UdpPacket::Type::END;
+	}
+
+	// Appends the records still held by the ring, oldest first, and returns how many were overwritten.
+	uint64_t ReadTrace(const std::string& path, std::vector<Record>& records) {
+		std::ifstream file(path, std::ios::binary);
+		PacketTracer::FileHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, PacketTracer::MAGIC,
+			sizeof(header.magic)) != 0) {
+			throw std::runtime_error(std::format("{} is not a trace file.", path));
+		}
+		if (header.version != PacketTracer::VERSION || header.recordSize != sizeof(Record) || header.capacity == 0) {
+			throw std::runtime_error(std::format("{} has an unsupported trace format.", path));
+		}
+
+		std::vector<Record> ring((size_t)header.capacity);
+		file.read((char*)ring.data(), (std::streamsize)(ring.size() * sizeof(Record)));
+		uint64_t count = std::min(header.written, header.capacity);
+		for (uint64_t i = header.written - count; i < header.written; ++i) {
+			const Record& record = ring[(size_t)(i % header.capacity)];
+			if (record.timestamp != 0) {
+				records.push_back(record);
+			}
+		}
+		return header.written - count;
+	}
+
+	// Client events of one sequence number, in time order.
+	typedef std::map<uint32_t, std::vector<const Record*>> ClientEvents;
+
+	bool HasClientEvent(const ClientEvents& client, uint32_t seq, uint64_t from, uint64_t to, Event event,
+		bool data) {
+		auto it = client.find(seq);
+		if (it == client.end()) {
+			return false;
+		}
+		auto first = std::upper_bound(it->second.begin(), it->second.end(), from,
+			[](uint64_t time, const Record* record) { return time < record->timestamp; });
+		for (; first != it->second.end() && (*first)->timestamp <= to; ++first) {
+			if ((*first)->event == event && IsData(**first) == data) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Decides why the data sent at `from` had to be sent again at `to` from what the client did in between.
+	Cause Classify(const ClientEvents& client, bool hasClient, uint32_t seq, uint64_t from, uint64_t to) {
+		if (!hasClient) {
+			return Cause::UNKNOWN;
+		}
+		if (HasClientEvent(client, seq, from, to, Event::DROP, true)) {
+			return Cause::DATA_LOST;
+		}
+		if (!HasClientEvent(client, seq, from, to, Event::RECEIVE, true)) {
+			return Cause::NOT_RECEIVED;
+		}
+		if (HasClientEvent(client, seq, from, to, Event::DROP, false)) {
+			return Cause::ACK_LOST;
+		}
+		if (HasClientEvent(client, seq, from, to, Event::SEND, false)) {
+			return Cause::SPURIOUS;
+		}
+		return Cause::OUT_OF_ORDER;
+	}
+
+	SessionReport Analyze(const std::vector<const Record*>& records) {
+		SessionReport report;
+		ClientEvents client;
+		bool hasClient = false;
+		for (const Record* record : records) {
+			if (record->side == Side::CLIENT) {
+				client[record->seq].push_back(record);
+				hasClient = true;
+			}
+		}
+
+		// Latest transmission of every sequence number; only a first transmission gives an RTT sample,
+		// since the ACK of a retransmitted packet cannot be matched to one of its copies.
+		struct Transmission {
+			uint64_t timestamp;
+			bool sample;
+		};
+		std::map<uint32_t, Transmission> sent;
+		for (const Record* record : records) {
+			size_t event = (size_t)record->event;
+			if (event < std::size(report.events)) {
+				++report.events[event];
+			}
+			if (record->side != Side::SERVER) {
+				continue;
+			}
+
+			if (IsData(*record) && (record->event == Event::SEND || record->event == Event::RETRANSMIT)) {
+				auto it = sent.find(record->seq);
+				if (record->event == Event::RETRANSMIT && it != sent.end()) {
+					++report.causes[(size_t)Classify(client, hasClient, record->seq, it->second.timestamp,
+						record->timestamp)];
+				}
+				sent[record->seq] = { record->timestamp, record->event == Event::SEND };
+			} else if (record->type == UdpPacket::Type::ACK && record->event == Event::RECEIVE) {
+				auto it = sent.find(record->seq);
+				if (it != sent.end() && it->second.sample) {
+					report.rtts.push_back((record->timestamp - it->second.timestamp) / 1e6);
+					it->second.sample = false;
+				}
+			}
+		}
+		return report;
+	}
+
+	void PrintReport(uint32_t session, SessionReport& report) {
+		std::cout << std::format("Transfer {}:", session) << std::endl;
+		std::cout << std::format("  send {}, retransmit {}, receive {}, drop {}, timeout {}",
+			report.events[(size_t)Event::SEND], report.events[(size_t)Event::RETRANSMIT],
+			report.events[(size_t)Event::RECEIVE], report.events[(size_t)Event::DROP],
+			report.events[(size_t)Event::TIMEOUT]) << std::endl;
+
+		std::vector<double>& rtts = report.rtts;
+		if (rtts.empty()) {
+			std::cout << "  no RTT samples" << std::endl;
+		} else {
+			std::sort(rtts.begin(), rtts.end());
+			double total = 0;
+			for (double rtt : rtts) {
+				total += rtt;
+			}
+			std::cout << std::format("  RTT over {} samples: min {:.3f} ms, mean {:.3f} ms, p50 {:.3f} ms, "
+				"p99 {:.3f} ms, max {:.3f} ms", rtts.size(), rtts.front(), total / rtts.size(),
+				rtts[rtts.size() / 2], rtts[rtts.size() * 99 / 100], rtts.back()) << std::endl;
+		}
+
+		for (size_t i = 0; i < (size_t)Cause::COUNT; ++i) {
+			if (report.causes[i] > 0) {
+				std::cout << std::format("  retransmitted, {}: {}", CAUSE_NAMES[i], report.causes[i]) << std::endl;
+			}
+		}
+	}
+
+	void WriteCsv(const std::string& path, const std::vector<Record>& records) {
+		std::ofstream csv(path);
+		if (!csv) {
+			throw std::runtime_error(std::format("Failed to open {}.", path));
+		}
+		csv << "time_ms,session,side,event,type,seq,size" << std::endl;
+		uint64_t start = records.empty() ? 0 : records.front().timestamp;
+		for (const Record& record : records) {
+			csv << std::format("{:.6f},{},{},{},{},{},{}", (record.timestamp - start) / 1e6, record.session,
+				record.side == Side::SERVER ? "server" : "client", EventName(record.event), TypeName(record.type),
+				record.seq, record.size) << std::endl;
+		}
+	}
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> paths;
+	std::string csvPath;
+	for (int i = 1; i < argc; ++i) {
+		std::string argument = argv[i];
+		if (argument == "-csv" && i + 1 < argc) {
+			csvPath = argv[++i];
+		} else {
+			paths.push_back(argument);
+		}
+	}
+	if (paths.empty()) {
+		std::cerr << "Usage: NulTraceAnalyzer <trace file>... [-csv <output file>]" << std::endl;
+		return 1;
+	}
+
+	try {
+		std::vector<Record> records;
+		uint64_t overwritten = 0;
+		for (const std::string& path : paths) {
+			overwritten += ReadTrace(path, records);
+		}
+		std::stable_sort(records.begin(), records.end(), [](const Record& left, const Record& right) {
+			return left.timestamp < right.timestamp;
+		});
+
+		std::cout << std::format("{} records, {} overwritten", records.size(), overwritten);
+		if (!records.empty()) {
+			std::cout << std::format(", spanning {:.3f} ms",
+				(records.back().timestamp - records.front().timestamp) / 1e6);
+		}
+		std::cout << std::endl;
+
+		std::map<uint32_t, std::vector<const Record*>> sessions;
+		for (const Record& record : records) {
+			sessions[record.session].push_back(&record);
+		}
+		for (auto& [session, events] : sessions) {
+			SessionReport report = Analyze(events);
+			PrintReport(session, report);
+		}
+
+		if (!csvPath.empty()) {
+			WriteCsv(csvPath, records);
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}